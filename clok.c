@@ -22,15 +22,113 @@
  * SOFTWARE.
  */
 
+// mmap, madvise, sigaction and the like are POSIX and Linux
+// extensions, which a strict -std= hides without this
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
 #include "clok.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <setjmp.h>
+#include <time.h>
+
+#if CK_HAVE_MMAP
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  include <signal.h>
+#endif
+
+#if CK_HAVE_TIMERFD
+#  include <sys/timerfd.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
 #define NUM_SLOTS             (UCHAR_MAX)
 #define RAND_COUNT            (128)
+#define FORWARD_CYCLES        (3)
+
+// CK_ADAPTIVE; blocks due more than a cycle ahead wait in
+// a list for the cycle they're due in, and a stable block's
+// preservation period grows up to 2^MAX_LEVEL cycles, which
+// has to stay well short of FAR_CYCLES
+#define FAR_CYCLES            (64)
+#define MAX_LEVEL             (5)
+
+// API traces; a record is an op byte and at most four
+// varints, so a buffer flush leaves room for one
+#define REC_BUFFER            (64 * 1024)
+#define REC_MAX_OP            (64)
+
+// members of a group after the first sit behind the tail of
+// a slim header, from 'eRef' on; its 'desc' marks it as one
+// and 'eRef' holds the offset back to the group's header.
+// the rest of the header is the previous member's data, so a
+// member must never be linked into a list; everything goes
+// through 'groupOf' first, and the list code asserts as much
+#define MEMBER_HEAD           ((sizeof(BlockSlim) - offsetof(BlockSlim, eRef) + 7) & ~(size_t)7)
+
+// region heap geometry; chunks are mapped at chunk alignment
+// so they can be backed by transparent huge pages, and pages
+// are aligned to their size so the page header of any block
+// can be found by masking its address
+#define REGION_PAGE           (1 << 14)
+#define REGION_CHUNK          (1 << 21)
+#define CHUNK_PAGES           (REGION_CHUNK / REGION_PAGE)
+#define PAGE_WORDS            (REGION_PAGE / 16 / 64)
+#define NUM_CLASSES           (28)
+#define NUM_DENSITIES         (4)
+#define LARGE_CLASS           (NUM_CLASSES)
+
+// slab pages keep an expiration slot byte per block in front
+// of the blocks, padded so the sweep can always read a whole
+// stride; free entries and roots hold SLOT_NONE, which is
+// never the current slot
+#define SLOT_STRIDE           (32)
+#define SLOT_NONE             (UCHAR_MAX)
+
+// the stack scan reads whole frames, redzones and all
+#if defined(__GNUC__)
+#  define NO_ASAN __attribute__(( no_sanitize_address ))
+#else
+#  define NO_ASAN
+#endif
+
+// number of threads that can be in 'ck_readEnter' at once
+#define READER_SLOTS          (64)
+
+// ticks a pool can run ahead of the pools holding refs into
+// it before those refs stop being enough, see 'ck_refRemote'
+#define REMOTE_SLACK          (4)
+
+// guarded blocks that stay mapped, and inaccessible, after
+// they're freed; the oldest is unmapped to make room
+#define GUARD_QUARANTINE      (64)
+
+// guarded blocks that can be live at once, sampling skips
+// allocations while they're all taken
+#define GUARD_LIVE            (256)
+
+// a pool with less than this fraction of its quota left is
+// under pressure, and collects ahead of time when it's idle
+#define IDLE_HEADROOM         (8)
+
+// sets of blocks that can be frozen at once, and the 'eCycle'
+// that marks a root as frozen; its 'eSlot' is the set
+#define FROZEN_SETS           (16)
+#define FROZEN_CYCLE          (UCHAR_MAX)
 
 // random number array used for quick randomization
 static const unsigned RAND_NUMS[RAND_COUNT] =
@@ -73,6 +171,21 @@ static const unsigned RAND_NUMS[RAND_COUNT] =
 typedef struct BlockSlim   BlockSlim;
 typedef struct BlockFat    BlockFat;
 typedef struct Schedule    Schedule;
+typedef struct Page        Page;
+typedef struct Chunk       Chunk;
+typedef struct Heap        Heap;
+typedef struct Table       Table;
+typedef struct Entry       Entry;
+typedef struct Busy        Busy;
+typedef struct Tag         Tag;
+typedef struct Reader      Reader;
+typedef struct Retired     Retired;
+typedef struct Image       Image;
+typedef struct ImageMap    ImageMap;
+typedef struct Range       Range;
+typedef struct Remote      Remote;
+typedef struct Guard       Guard;
+typedef struct Frozen      Frozen;
 
 typedef unsigned char  uchar;
 typedef unsigned int   uint;
@@ -80,6 +193,212 @@ typedef unsigned short ushort;
 typedef uchar          Slot;
 typedef ushort         Desc;
 typedef ushort         Size;
+typedef uchar          Flags;
+
+// extra block flags, kept apart from the 'desc' bits; the
+// high bits hold the block's allocation tag
+enum
+{
+    FLAG_WEAK  = 1 << 0, // has weak handles in the weak table
+    FLAG_MOVED = 1 << 1, // relocated by compaction, 'eRef' is the new block
+    FLAG_EFAR  = 1 << 2, // expires in cycle 'eCycle', it's in an 'eFar' list
+    FLAG_PFAR  = 1 << 3  // preserved in cycle 'pCycle', it's in a 'pFar' list
+};
+
+#define TAG_SHIFT             (4)
+
+// region heap size classes, a block goes into the
+// smallest class that fits it, anything bigger than
+// the largest class gets its own mapping
+static const uint CLASS_SIZES[NUM_CLASSES] =
+{
+      16,   32,   48,   64,   80,   96,  112,  128,
+     160,  192,  224,  256,  320,  384,  448,  512,
+     640,  768,  896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096
+};
+
+struct Heap
+{
+    // all mapped chunks
+    Chunk* chunks;
+    
+    // partially used pages of each class, bucketed by
+    // how full they are; allocation is steered toward
+    // the densest pages so sparse ones can drain and
+    // be released.  slab pages have their own buckets
+    Page* partial[2][NUM_CLASSES][NUM_DENSITIES];
+    
+    // all slab pages, for the expiration sweep
+    Page* slabs;
+    
+    // mappings of blocks too big for any class
+    Page* large;
+    
+    // sparse pages being emptied by CK_COMPACT, these
+    // aren't in the buckets so nothing new goes into them
+    Page* evacuating;
+    
+    // bytes of pages currently in use
+    size_t resident;
+};
+
+// open addressed pointer map, used for the side tables
+// that only a few blocks have entries in
+struct Entry
+{
+    void* key;
+    void* val;
+};
+
+struct Table
+{
+    Entry* entries;
+    size_t cap;
+    size_t count;
+};
+
+struct ck_Weak
+{
+    // all of the pool's handles
+    ck_Weak*  next;
+    ck_Weak** ref;
+    
+    // other handles to the same block
+    ck_Weak*  chain;
+    
+    void*     alloc;
+};
+
+// blocks that compaction has to leave alone for now,
+// linked through the stack frames of 'doPreserve' and
+// 'allocRaw' since their callers are still using them
+struct Busy
+{
+    BlockFat* block;
+    Busy*     next;
+};
+
+// accounting for one allocation tag, 'pending' is the
+// part of 'used' waiting in the finalization queue
+struct Tag
+{
+    size_t quota;
+    size_t used;
+    size_t pending;
+};
+
+// a reader's slot, holding the epoch it entered at or zero
+// when it's free; padded so readers on different cores don't
+// fight over a cache line
+struct Reader
+{
+    _Atomic(uint64_t) epoch;
+    char              pad[64 - sizeof(uint64_t)];
+};
+
+// memory freed while readers may still be looking at it,
+// with the epoch it was freed in
+struct Retired
+{
+    void*    ptr;
+    uint64_t epoch;
+};
+
+// a stack for CK_SCAN_STACKS, 'lo' is NULL for the
+// collecting thread's
+struct Range
+{
+    void const* lo;
+    void const* hi;
+};
+
+// a ref from a block in another pool, waiting in this pool's
+// inbox; 'ticks' is how long until the owner's next preserve,
+// by the other pool's clock.  applied entries go back to
+// 'home', which allocated them
+struct Remote
+{
+    Remote*  next;
+    void*    alloc;
+    ck_Pool* home;
+    uint     ticks;
+};
+
+// a block sampled by 'ck_guard', alone in its own mapping
+// and flush against a guard page; the rest is filled in
+// when it expires, for the report if it's used after that
+struct Guard
+{
+    void*  base;
+    size_t span;
+    void*  block;
+    size_t size;
+    void*  alloc;
+    void*  owner;
+    uint   clock;
+    uint   live;
+    Slot   eSlot;
+    bool   fat;
+    bool   expired;
+};
+
+// blocks taken out of collection by 'ck_freeze', they look
+// like roots and are linked through 'eNext' in 'blocks', the
+// fat ones through 'pNext' in 'fats' too, in the order they
+// were frozen.  slab blocks have no links so they're listed
+// in 'slabs'.  'rooted' is cleared if 'root' is unrooted
+// while it's frozen
+struct Frozen
+{
+    BlockSlim*  root;
+    BlockSlim*  blocks;
+    BlockFat*   fats;
+    BlockFat**  fatTail;
+    void**      slabs;
+    size_t      nSlabs;
+    size_t      capSlabs;
+    bool        rooted;
+};
+
+// pool image header, written by 'ck_savePool'; the image
+// is the pool's heap mappings as they are in memory, so
+// 'layout' makes sure it's read by a matching build
+struct Image
+{
+    char       magic[8];
+    uint       layout[6];
+    uint       flags;
+    uint       clock;
+    uint       rand;
+    size_t     used;
+    size_t     nMaps;
+    BlockSlim* eSchedule[NUM_SLOTS];
+    BlockFat*  pSchedule[NUM_SLOTS];
+    BlockSlim* roots;
+    BlockSlim* tombs[NUM_SLOTS];
+    BlockSlim* forwards[FORWARD_CYCLES];
+    Tag        tags[CK_MAX_TAGS];
+    BlockSlim* eFar[FAR_CYCLES];
+    BlockFat*  pFar[FAR_CYCLES];
+    BlockSlim* tombsFar[FAR_CYCLES];
+    size_t     eBytes[NUM_SLOTS];
+    size_t     eFarBytes[FAR_CYCLES];
+    size_t     fwdBytes[FORWARD_CYCLES];
+    Frozen     frozen[FROZEN_SETS];
+};
+
+// one of the image's mappings, a chunk or a large block;
+// 'free' is the chunk's page map, free pages are left as
+// holes in the file
+struct ImageMap
+{
+    void*    addr;
+    size_t   size;
+    uint64_t offset;
+    uint64_t free[CHUNK_PAGES / 64];
+    bool     large;
+};
 
 struct ck_Pool
 {
@@ -90,9 +409,180 @@ struct ck_Pool
     BlockSlim* eSchedule[NUM_SLOTS]; // expire
     BlockFat*  pSchedule[NUM_SLOTS]; // preserve
     
-    // roots and orphan lists
+    // slots that might have something in them, a bit's set
+    // when a block or tomb goes in the slot and cleared when
+    // its tick finds it empty; lets idle ticks be skipped
+    uint64_t slotMask[(NUM_SLOTS + 63) / 64];
+    
+    // blocks due in later cycles, by cycle; each list goes
+    // into the schedules when its cycle starts.  tombs of
+    // blocks preserved in a later cycle wait for the end of
+    // that cycle
+    BlockSlim* eFar[FAR_CYCLES];
+    BlockFat*  pFar[FAR_CYCLES];
+    BlockSlim* tombsFar[FAR_CYCLES];
+    
+    // bytes due to be freed by each slot's tick, from the
+    // blocks expiring in it (slab blocks included) and the
+    // tombs waiting on it; and the same for each far cycle,
+    // which is everything it'll bring into the schedules
+    size_t eBytes[NUM_SLOTS];
+    size_t eFarBytes[FAR_CYCLES];
+    
+    // roots list
     BlockSlim*   roots;
-    BlockFat*    orphans;
+    
+    // frozen sets, and the one whose blocks are being walked
+    Frozen       frozen[FROZEN_SETS];
+    Frozen*      freezing;
+    
+    // region heap, only used with CK_REGION_HEAP
+    Heap heap;
+    
+    // weak handles, the table maps blocks to their
+    // handle chains
+    Table    weakTable;
+    ck_Weak* weaks;
+    
+    // interned slim blocks, 'interns' maps content hashes to
+    // the blocks and 'internOf' maps them back, keyed like the
+    // weak table; 'internSize' has their exact sizes, which
+    // their headers only have rounded.  only one block is
+    // interned per hash
+    Table    interns;
+    Table    internOf;
+    Table    internSize;
+    
+    // finalization queue, blocks wait here for their
+    // 'expire' call and are then pushed onto 'finalized'
+    // to be freed by the pool's thread
+    atomic_flag           finalLock;
+    BlockSlim*            finalHead;
+    BlockSlim*            finalTail;
+    _Atomic(BlockSlim*)   finalized;
+    size_t                pending;
+    
+    // expired blocks that are still some other block's
+    // owner, freed when their preservation slot comes up
+    BlockSlim* tombs[NUM_SLOTS];
+    bool       closing;
+    
+    // blocks from the last CK_EVENT_EXPIRE, waiting to be freed
+    BlockSlim* expiring;
+    
+    // blocks that can't be moved right now, the busy stack
+    // and the block from the last CK_EVENT_PRESERVE
+    Busy*      busy;
+    BlockFat*  eventBlock;
+    
+    // old copies of moved blocks by the cycle they were moved
+    // in; the pointers a block holds are only refreshed when
+    // it's preserved, which can be most of two cycles apart
+    BlockSlim* forwards[FORWARD_CYCLES];
+    size_t     fwdBytes[FORWARD_CYCLES];
+    
+    // sub-quotas, every block counts against its tag as
+    // well as the pool's quota
+    Tag tags[CK_MAX_TAGS];
+    
+    // set while a 'ck_tryAlloc*' call is in progress, the
+    // allocation can't collect and reports here instead;
+    // 'expired' counts bytes expired in the current tick
+    ck_Shortfall* shortfall;
+    size_t        expired;
+    
+    // epoch based read protection; once a reader has shown
+    // up, freed memory is retired with the current epoch and
+    // only released after every reader has moved past it.
+    // the epoch advances once per tick
+    _Atomic(uint64_t) epoch;
+    atomic_bool       readersSeen;
+    Reader            readers[READER_SLOTS];
+    Retired*          retired;
+    size_t            nRetired;
+    size_t            capRetired;
+    
+    // root stack, its entries are kept from expiring for
+    // as long as they're on it
+    void** stack;
+    size_t depth;
+    size_t stackCap;
+    
+    // API trace, 'recBuf' is NULL unless recording; addresses
+    // are written relative to 'recLast'
+    int       recFd;
+    uchar*    recBuf;
+    size_t    recLen;
+    uintptr_t recLast;
+    
+    // CK_SCAN_STACKS; the stacks, the page map from the address
+    // of each heap page in use to its header, and the bounds of
+    // everything that's been in it.  'scanHits' has the blocks
+    // found by this tick's scan, keyed by where they start;
+    // 'scanLost' is set when a scan or the page map came up
+    // short, so everything is treated as found
+    Range*    scans;
+    size_t    nScans;
+    size_t    capScans;
+    Table     pageMap;
+    uintptr_t mapLo;
+    uintptr_t mapHi;
+    Table     scanHits;
+    bool      scanned;
+    bool      scanLost;
+    bool      mapLost;
+    
+    // refs from other pools; they push onto 'inbox' from their
+    // own threads and it's drained at the start of each tick.
+    // 'spent' has this pool's entries handed back by the
+    // pools they went to, and 'spare' the ones ready for reuse
+    _Atomic(Remote*) inbox;
+    _Atomic(Remote*) spent;
+    Remote*          spare;
+    
+    // guarded sampling; every 'guardEvery'th allocation goes
+    // in a mapping of its own, found in 'guards' by its block.
+    // the fault handler can't look in the table, since it may
+    // be in the middle of growing, so the live ones are in
+    // 'live' too; freed ones wait in 'quarantine'.  pools with
+    // sampling on are chained from 'guardPools' so a fault can
+    // be traced
+    Table    guards;
+    Guard*   live[GUARD_LIVE];
+    Guard*   quarantine[GUARD_QUARANTINE];
+    uint     nextQuarantine;
+    uint     guardEvery;
+    uint     guardCount;
+    ck_Pool* guardNext;
+    
+    // time driven ticks, 'clockBase' is the clock when the
+    // time source was set, at time 'timeBase'; one tick is
+    // 'tickTime' of its units, or of ticks without a source
+    ck_Time  timeNow;
+    uint64_t timeBase;
+    uint64_t tickTime;
+    uint     clockBase;
+    
+    // idle collection; 'timerTick' is the tick the timer's
+    // set to go off at, or it's 'timerHot' if there's work
+    // already.  allocations past 'timerLimit' re-arm it
+    int    timerFd;
+    bool   timerHot;
+    uint   timerTick;
+    size_t timerLimit;
+    
+    // full collection; marked blocks are out of their schedule
+    // and linked through 'eNext' from 'marked', with 'eRef'
+    // pointing at it.  marked slab blocks are out of their slot,
+    // which is kept in 'slabMarks' to put them back; 'markLost'
+    // is set if one didn't fit, then the slabs aren't swept
+    bool        marking;
+    bool        markLost;
+    BlockSlim*  marked;
+    BlockSlim** markTail;
+    Entry*      slabMarks;
+    size_t      nSlabMarks;
+    size_t      capSlabMarks;
     
     // other
     uint   clock;
@@ -110,7 +600,9 @@ struct BlockSlim
     BlockSlim*    eNext;
     BlockSlim**   eRef;
     Slot          eSlot;
+    Flags         flags;
     Desc          desc;
+    uchar         eCycle;
     
     // data follows
 };
@@ -121,9 +613,17 @@ struct BlockFat
     BlockFat*   pNext;
     BlockFat**  pRef;
     Slot        pSlot;
+    uchar       pCycle;
     
-    // cycle detection
+    // CK_ADAPTIVE, the block is preserved every 2^level
+    // cycles; it goes up each time it's preserved and back
+    // to zero when it gets a new owner
+    uchar       level;
+    
+    // cycle detection, 'owns' counts the blocks that
+    // name this one as their owner
     uchar       cycleCD;
+    uint        owns;
     BlockFat*   owner;
     
     BlockSlim   slim;
@@ -135,10 +635,101 @@ struct BlockFat
 #  pragma pack( pop )
 #endif
 
+// chunk bookkeeping is kept outside of the mapping
+// so releasing a page doesn't lose any of it
+struct Chunk
+{
+    Chunk*   next;
+    void*    base;
+    uint64_t free[CHUNK_PAGES / 64];
+    uint     nFree;
+};
+
+// page header, sits at the start of every region page
+// and large mapping
+struct Page
+{
+    Page*    next;
+    Page**   ref;
+    Chunk*   chunk;
+    size_t   span;
+    ushort   klass;
+    ushort   count;
+    ushort   cap;
+    uchar    density;
+    uchar    evac;
+    uchar    slab;
+    ushort   base;
+    uint64_t bits[PAGE_WORDS];
+    
+    // slab pages only; 'recip' turns block offsets into
+    // indices without a divide, and 'slotMask' has a bit
+    // for each slot that may be in the page's slot bytes
+    uint     recip;
+    Page*    slabNext;
+    Page**   slabRef;
+    uint64_t slotMask[(NUM_SLOTS + 63) / 64];
+    
+    // slot bytes and blocks follow
+};
+
+#define PAGE_HEAD ((sizeof(Page) + 15) & ~(size_t)15)
+
 
 // helper prototypes
+static void*
+allocSlim( ck_Pool* pool, size_t size, void* owner, uint tag );
+
+static void*
+allocFat( ck_Pool* pool, size_t size, void* owner, uint tag );
+
+static inline void*
+allocRaw( ck_Pool* pool, size_t size, void* owner, uint tag );
+
+static inline bool
+makeRoom( ck_Pool* pool, size_t size, void* owner, uint tag );
+
+static inline void
+collectFor( ck_Pool* pool, size_t size, uint tag );
+
+static inline bool
+hasRoom( ck_Pool* pool, size_t size, uint tag, bool early );
+
+static void
+noteShortfall( ck_Pool* pool, size_t size, uint tag );
+
+static inline size_t
+shortBy( ck_Pool* pool, size_t size, uint tag );
+
+static uint
+forecast( ck_Pool* pool, size_t bytes );
+
 static inline void*
-allocRaw( ck_Pool* pool, size_t size );
+memAlloc( ck_Pool* pool, size_t size );
+
+static inline void
+memFree( ck_Pool* pool, void* ptr );
+
+static inline void
+memRelease( ck_Pool* pool, void* ptr );
+
+static void
+retire( ck_Pool* pool, void* ptr );
+
+static void
+reclaim( ck_Pool* pool, bool wait );
+
+static uint64_t
+oldestReader( ck_Pool* pool );
+
+static inline Slot
+lastSlot( ck_Pool* pool );
+
+static void
+keepStack( ck_Pool* pool );
+
+static inline void
+keepStacked( ck_Pool* pool, void* alloc );
 
 static inline BlockSlim*
 ptrToSlim( void* ptr );
@@ -182,6 +773,18 @@ setDesc( BlockSlim* block, Size size, bool isFat, bool isRoot );
 static inline void
 setOwner( BlockSlim* block, BlockFat* owner );
 
+static inline void
+setFlag( BlockSlim* block, Flags flag, bool on );
+
+static inline bool
+hasFlag( BlockSlim* block, Flags flag );
+
+static inline void
+setTag( BlockSlim* block, uint tag );
+
+static inline uint
+getTag( BlockSlim* block );
+
 static inline Size
 getSize( BlockSlim* block );
 
@@ -194,11 +797,20 @@ isFat( BlockSlim* block );
 static inline bool
 isOrphan( BlockSlim* block );
 
+static inline bool
+isMember( BlockSlim* block );
+
+static inline void*
+groupOf( void* ptr );
+
 static inline void
 eInsert( ck_Pool* pool, BlockSlim* block );
 
 static inline void
-eExtract( BlockSlim* block );
+eExtract( ck_Pool* pool, BlockSlim* block );
+
+static inline size_t*
+dueBytes( ck_Pool* pool, BlockSlim* block );
 
 static inline void
 pInsert( ck_Pool* pool, BlockFat* block );
@@ -209,11 +821,166 @@ pExtract( BlockFat* block );
 static inline void
 doExpire( ck_Pool* pool, BlockSlim* block );
 
+static inline bool
+unlinkExpired( ck_Pool* pool, BlockSlim* block );
+
+static inline void
+freeBlock( ck_Pool* pool, BlockSlim* block );
+
+static inline size_t
+blockBytes( BlockSlim* block );
+
+static inline void
+drainFinalized( ck_Pool* pool );
+
+static void
+drainRemote( ck_Pool* pool );
+
+static void
+applyRemote( ck_Pool* pool, void* alloc, uint ticks );
+
+static void
+keepFor( ck_Pool* pool, void* alloc, uint ticks );
+
+static inline void
+scheduleIn( ck_Pool* pool, BlockSlim* block, uint ticks );
+
+static inline uint
+ttlTicks( ck_Pool* pool, uint64_t ttl );
+
+static uint64_t
+monotonicNow( void* context );
+
+static inline uint
+timeTarget( ck_Pool* pool );
+
+static inline uint
+idleAhead( ck_Pool* pool );
+
+static void
+idleStep( ck_Pool* pool, uint until );
+
+static void
+armTimer( ck_Pool* pool );
+
+static void
+timerDue( ck_Pool* pool, Slot slot );
+
+static inline bool
+isFrozen( BlockSlim* block );
+
+static void
+freezeRef( ck_Pool* pool, void* alloc, BlockFat* owner, bool walk );
+
+static void
+freezeBlock( ck_Pool* pool, BlockSlim* block, Frozen* frozen );
+
+static void
+freezeWalk( ck_Pool* pool, Frozen* frozen, BlockFat* from );
+
+static inline void
+giveCycle( ck_Pool* pool, BlockSlim* block );
+
+static size_t
+collectAll( ck_Pool* pool );
+
+static bool
+markAll( ck_Pool* pool );
+
+static inline void
+doMark( ck_Pool* pool, BlockFat* block );
+
+static void
+markRef( ck_Pool* pool, void* alloc );
+
+static inline void
+markBlock( ck_Pool* pool, BlockSlim* block );
+
+static inline bool
+isMarked( ck_Pool* pool, BlockSlim* block );
+
+static void
+sweepAll( ck_Pool* pool );
+
+static void
+sweepSlabs( ck_Pool* pool );
+
+static void
+unmarkAll( ck_Pool* pool );
+
+static inline void
+pushRemote( _Atomic(Remote*)* list, Remote* entry );
+
+static void*
+guardAlloc( ck_Pool* pool, size_t size, void* owner );
+
+static void
+guardExpire( ck_Pool* pool, BlockSlim* block );
+
+static void
+guardRelease( ck_Pool* pool, Guard* guard );
+
+static bool
+guardWatch( ck_Pool* pool, bool on );
+
+#if CK_HAVE_MMAP
+static void
+guardFault( int sig, siginfo_t* info, void* context );
+
+static void
+reportStr( char* buf, size_t* len, char const* str );
+
+static void
+reportNum( char* buf, size_t* len, uint64_t num, uint base );
+#endif
+
+static Guard*
+guardFind( Guard* guard, void* addr );
+
+static inline void
+freeTombs( ck_Pool* pool, Slot slot );
+
+static inline void
+freeDead( ck_Pool* pool, BlockSlim* block, size_t* due );
+
+static inline void
+endTick( ck_Pool* pool, Slot slot );
+
+static void
+doTick( ck_Pool* pool );
+
+static size_t
+doAdvance( ck_Pool* pool, size_t maxTicks );
+
+static inline void
+markSlot( ck_Pool* pool, Slot slot );
+
+static inline uint
+idleSpan( ck_Pool* pool, Slot slot );
+
+static inline void
+skipTicks( ck_Pool* pool, uint ticks );
+
+static inline void
+disownAll( ck_Pool* pool, BlockFat* owner );
+
 static inline void
 doPreserve( ck_Pool* pool, BlockFat* block );
 
 static inline void
-toOrphan( ck_Pool* pool, BlockFat* block );
+schedPreserve( ck_Pool* pool, BlockFat* block );
+
+static inline bool
+inCycle( BlockFat* block );
+
+static inline void
+disown( BlockFat* block );
+
+static inline void
+toOrphan( BlockFat* block );
+
+static inline void
+orphanRef( ck_Pool* pool, BlockFat* owner, BlockSlim* block );
 
 static inline void
 toRoot( ck_Pool* pool, BlockSlim* block );
@@ -224,45 +991,419 @@ shouldRef( ck_Pool* pool, BlockFat* owner, BlockSlim* block );
 static inline bool
 isBefore( ck_Pool* pool, Slot before, Slot after );
 
+static inline uint
+dueIn( ck_Pool* pool, Slot slot, uchar cycle, bool far );
+
+static void
+flushFar( ck_Pool* pool );
+
 static inline void
 setPreserveSlot( ck_Pool* pool, BlockFat* block );
 
+static inline bool
+canMove( ck_Pool* pool, BlockSlim* block );
 
-// api implementation
-ck_Pool*
-ck_makePool( ck_Config const* config )
-{
-    ck_Pool* pool = config->alloc( config->context,
-                                   NULL,
-                                   sizeof(*pool) );
-    pool->config  = *config;
-    pool->roots   = NULL;
-    pool->orphans = NULL;
-    pool->clock   = 0;
-    pool->rand    = 0;
-    pool->used    = 0;
-    
-    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
-    {
-        pool->eSchedule[i] = NULL;
-        pool->pSchedule[i] = NULL;
-    }
-    
-    return pool;
-}
+static BlockSlim*
+moveBlock( ck_Pool* pool, BlockSlim* block );
 
-void
-ck_freePool( ck_Pool* pool )
-{
-    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
-    {
-        while( pool->eSchedule[i] )
-            doExpire( pool, pool->eSchedule[i] );
-    }
-    
-    while( pool->roots )
+static inline BlockSlim*
+resolveMoved( BlockSlim* block );
+
+static void*
+heapAlloc( ck_Pool* pool, size_t size );
+
+static void*
+classAlloc( ck_Pool* pool, uint klass, bool slab );
+
+static void
+heapFree( ck_Pool* pool, void* ptr );
+
+static void
+heapClear( ck_Pool* pool );
+
+static void
+heapCompact( ck_Pool* pool );
+
+static inline uint
+sizeClass( size_t size );
+
+static inline Page*
+ptrToPage( void* ptr );
+
+static inline void
+pageLink( Heap* heap, Page* page );
+
+static inline void
+pageUnlink( Page* page );
+
+static Page*
+pageAcquire( ck_Pool* pool, uint klass, bool slab );
+
+static void
+pageRelease( ck_Pool* pool, Page* page );
+
+static void*
+mapAligned( size_t size, size_t align );
+
+static bool
+mapPages( ck_Pool* pool, void* base, size_t span, Page* page );
+
+static inline bool
+isSlab( ck_Pool* pool, void* ptr );
+
+static inline uchar*
+slabSlot( void* ptr );
+
+static void*
+slabAlloc( ck_Pool* pool, size_t size, void* owner );
+
+static inline void
+slabRef( ck_Pool* pool, void* alloc, void* owner );
+
+static inline void
+slabMark( ck_Pool* pool, void* alloc, Slot slot );
+
+static void
+slabSweep( ck_Pool* pool, Slot slot );
+
+static inline uint
+slotMatch( uchar const* slots, Slot slot );
+
+static void
+slabExpire( ck_Pool* pool, Page* page, uint idx );
+
+static void
+slabExpireAll( ck_Pool* pool );
+
+static inline bool
+scanOnce( ck_Pool* pool );
+
+static void
+scanStacks( ck_Pool* pool );
+
+static void
+scanRange( ck_Pool* pool, void const* lo, void const* hi );
+
+static inline bool
+keepScanned( ck_Pool* pool, BlockSlim* block );
+
+static void
+imageLayout( uint* layout );
+
+static bool
+writeAll( int fd, void const* buf, size_t size, uint64_t offset );
+
+static bool
+readAll( int fd, void* buf, size_t size, uint64_t offset );
+
+static void*
+imageReserve( ImageMap* maps, size_t nMaps, bool fixed );
+
+static void
+imageAdopt( ck_Pool* pool, ImageMap* maps, size_t nMaps, ptrdiff_t delta );
+
+static void
+imageRelink( ck_Pool* pool, ptrdiff_t delta );
+
+static void
+imageRestore( ck_Pool* pool, ptrdiff_t delta );
+
+static inline void*
+shift( void* ptr, ptrdiff_t delta );
+
+static void
+recOp( ck_Pool* pool, uint op );
+
+static inline void
+recNum( ck_Pool* pool, uint64_t num );
+
+static inline void
+recAddr( ck_Pool* pool, void* addr );
+
+static bool
+recFlush( ck_Pool* pool );
+
+static inline size_t
+tableHash( void* key, size_t cap );
+
+static void*
+tableGet( Table* table, void* key );
+
+static bool
+tablePut( ck_Pool* pool, Table* table, void* key, void* val );
+
+static void*
+tableDel( Table* table, void* key );
+
+static void
+tableFree( ck_Pool* pool, Table* table );
+
+static void
+clearWeak( ck_Pool* pool, BlockSlim* block );
+
+static inline uint64_t
+hashBytes( void const* data, size_t size );
+
+static void
+forgetInterned( ck_Pool* pool, BlockSlim* block );
+
+static inline void
+tempRef( ck_Pool* pool, void* alloc );
+
+
+// api implementation
+ck_Pool*
+ck_makePool( ck_Config const* config )
+{
+    ck_Pool* pool = config->alloc( config->context,
+                                   NULL,
+                                   sizeof(*pool) );
+    pool->config  = *config;
+    pool->roots   = NULL;
+    pool->clock   = 0;
+    pool->rand    = 0;
+    pool->used    = 0;
+    
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+    {
+        pool->eSchedule[i] = NULL;
+        pool->pSchedule[i] = NULL;
+        pool->tombs[i]     = NULL;
+        pool->eBytes[i]    = 0;
+    }
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+    {
+        pool->eFar[i]      = NULL;
+        pool->pFar[i]      = NULL;
+        pool->tombsFar[i]  = NULL;
+        pool->eFarBytes[i] = 0;
+    }
+    
+    memset( pool->slotMask, 0, sizeof(pool->slotMask) );
+    memset( &pool->heap, 0, sizeof(pool->heap) );
+    memset( &pool->weakTable, 0, sizeof(pool->weakTable) );
+    pool->weaks = NULL;
+    memset( &pool->interns, 0, sizeof(pool->interns) );
+    memset( &pool->internOf, 0, sizeof(pool->internOf) );
+    memset( &pool->internSize, 0, sizeof(pool->internSize) );
+    
+    atomic_flag_clear( &pool->finalLock );
+    atomic_init( &pool->finalized, NULL );
+    pool->finalHead = NULL;
+    pool->finalTail = NULL;
+    pool->pending   = 0;
+    pool->closing   = false;
+    pool->expiring  = NULL;
+    
+    pool->busy       = NULL;
+    pool->eventBlock = NULL;
+    for( uint i = 0 ; i < FORWARD_CYCLES ; i++ )
+    {
+        pool->forwards[i] = NULL;
+        pool->fwdBytes[i] = 0;
+    }
+    
+    for( uint i = 0 ; i < CK_MAX_TAGS ; i++ )
+    {
+        pool->tags[i].quota   = SIZE_MAX;
+        pool->tags[i].used    = 0;
+        pool->tags[i].pending = 0;
+    }
+    
+    pool->shortfall = NULL;
+    pool->expired   = 0;
+    
+    atomic_init( &pool->epoch, 1 );
+    atomic_init( &pool->readersSeen, false );
+    for( uint i = 0 ; i < READER_SLOTS ; i++ )
+        atomic_init( &pool->readers[i].epoch, 0 );
+    pool->retired    = NULL;
+    pool->nRetired   = 0;
+    pool->capRetired = 0;
+    
+    pool->stack    = NULL;
+    pool->depth    = 0;
+    
+    pool->recFd   = -1;
+    pool->recBuf  = NULL;
+    pool->recLen  = 0;
+    pool->recLast = 0;
+    pool->stackCap = 0;
+    
+    pool->scans    = NULL;
+    pool->nScans   = 0;
+    pool->capScans = 0;
+    pool->mapLo    = UINTPTR_MAX;
+    pool->mapHi    = 0;
+    pool->scanned  = false;
+    pool->scanLost = false;
+    pool->mapLost  = false;
+    memset( &pool->pageMap, 0, sizeof(pool->pageMap) );
+    memset( &pool->scanHits, 0, sizeof(pool->scanHits) );
+    
+    atomic_init( &pool->inbox, NULL );
+    atomic_init( &pool->spent, NULL );
+    pool->spare = NULL;
+    
+    memset( &pool->guards, 0, sizeof(pool->guards) );
+    memset( pool->live, 0, sizeof(pool->live) );
+    memset( pool->quarantine, 0, sizeof(pool->quarantine) );
+    pool->nextQuarantine = 0;
+    pool->guardEvery     = 0;
+    pool->guardCount     = 0;
+    pool->guardNext      = NULL;
+    
+    pool->timeNow   = NULL;
+    pool->timeBase  = 0;
+    pool->tickTime  = 1;
+    pool->clockBase = 0;
+    
+    memset( pool->frozen, 0, sizeof(pool->frozen) );
+    pool->freezing = NULL;
+    
+    pool->timerFd    = -1;
+    pool->timerHot   = false;
+    pool->timerTick  = 0;
+    pool->timerLimit = SIZE_MAX;
+    
+    pool->marking      = false;
+    pool->markLost     = false;
+    pool->marked       = NULL;
+    pool->markTail     = &pool->marked;
+    pool->slabMarks    = NULL;
+    pool->nSlabMarks   = 0;
+    pool->capSlabMarks = 0;
+    
+    // compaction moves blocks between region pages
+    if( pool->config.flags & CK_COMPACT )
+        pool->config.flags |= CK_REGION_HEAP;
+    
+    // words found on a stack can't be updated when their
+    // block moves, and they're looked up in the region
+    // heap's page map
+    if( pool->config.flags & CK_SCAN_STACKS )
+        pool->config.flags = (pool->config.flags & ~CK_COMPACT) | CK_REGION_HEAP;
+    
+    // slab blocks have no header to queue them with, or
+    // to keep a cycle in
+    if( pool->config.flags & (CK_DEFER_FINALIZE | CK_ADAPTIVE) )
+        pool->config.flags &= ~CK_SLAB_SLIM;
+    
+    // slabs live on region pages, and once they're in use
+    // any pointer has to be checkable for a page header
+    if( pool->config.flags & CK_SLAB_SLIM )
+        pool->config.flags |= CK_REGION_HEAP;
+    
+    if( !CK_HAVE_MMAP )
+        pool->config.flags &= ~(CK_REGION_HEAP | CK_HUGE_PAGES |
+                                CK_COMPACT | CK_SLAB_SLIM | CK_SCAN_STACKS);
+    
+    return pool;
+}
+
+void
+ck_freePool( ck_Pool* pool )
+{
+    ck_record( pool, -1 );
+    
+    // everything goes, so there's no need to keep
+    // owners around for cycle detection
+    pool->closing = true;
+    
+    // refs from other pools don't matter anymore, but their
+    // entries still have to go home
+    Remote* entry = atomic_exchange( &pool->inbox, NULL );
+    while( entry )
+    {
+        Remote* next = entry->next;
+        pushRemote( &entry->home->spent, entry );
+        entry = next;
+    }
+    
+    // readers should be gone by now, so everything that
+    // was waiting on them can go, and the rest right away
+    reclaim( pool, true );
+    atomic_store( &pool->readersSeen, false );
+    
+    while( pool->expiring )
+    {
+        BlockSlim* block = pool->expiring;
+        pool->expiring = block->eNext;
+        freeBlock( pool, block );
+    }
+    
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+    {
+        while( pool->eSchedule[i] )
+            doExpire( pool, pool->eSchedule[i] );
+    }
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+    {
+        while( pool->eFar[i] )
+            doExpire( pool, pool->eFar[i] );
+    }
+    
+    while( pool->roots )
         doExpire( pool, pool->roots );
+    for( uint i = 0 ; i < FROZEN_SETS ; i++ )
+    {
+        while( pool->frozen[i].blocks )
+            doExpire( pool, pool->frozen[i].blocks );
+        pool->config.alloc( pool->config.context, pool->frozen[i].slabs, 0 );
+    }
+    
+    if( pool->config.flags & CK_SLAB_SLIM )
+        slabExpireAll( pool );
+    
+    ck_runFinalizers( pool, SIZE_MAX );
+    drainFinalized( pool );
+    
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+        freeTombs( pool, i );
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+        freeDead( pool, pool->tombsFar[i], NULL );
+    for( uint i = 0 ; i < FORWARD_CYCLES ; i++ )
+        freeDead( pool, pool->forwards[i], NULL );
+    
+    guardWatch( pool, false );
+    for( uint i = 0 ; i < GUARD_QUARANTINE ; i++ )
+    {
+        if( pool->quarantine[i] != NULL )
+            guardRelease( pool, pool->quarantine[i] );
+    }
+    tableFree( pool, &pool->guards );
+    
+#if CK_HAVE_TIMERFD
+    if( pool->timerFd >= 0 )
+        close( pool->timerFd );
+#endif
+    
+    while( pool->weaks )
+        ck_freeWeak( pool, pool->weaks );
+    tableFree( pool, &pool->weakTable );
+    tableFree( pool, &pool->interns );
+    tableFree( pool, &pool->internOf );
+    tableFree( pool, &pool->internSize );
+    
+    // this pool's own entries, the ones still out in other
+    // pools' inboxes should have been drained by now
+    Remote* spares[2] = { pool->spare, atomic_exchange( &pool->spent, NULL ) };
+    for( uint i = 0 ; i < 2 ; i++ )
+    {
+        while( spares[i] )
+        {
+            Remote* next = spares[i]->next;
+            pool->config.alloc( pool->config.context, spares[i], 0 );
+            spares[i] = next;
+        }
+    }
     
+    pool->config.alloc( pool->config.context, pool->retired, 0 );
+    pool->config.alloc( pool->config.context, pool->stack, 0 );
+    pool->config.alloc( pool->config.context, pool->scans, 0 );
+    tableFree( pool, &pool->pageMap );
+    tableFree( pool, &pool->scanHits );
+    heapClear( pool );
     pool->config.alloc( pool->config.context,
                         pool,
                         0 );
@@ -270,14 +1411,56 @@ ck_freePool( ck_Pool* pool )
 
 void*
 ck_allocSlim( ck_Pool* pool, size_t size, void* owner )
+{
+    return ck_allocSlimTagged( pool, size, owner, 0 );
+}
+
+void*
+ck_allocSlimTagged( ck_Pool* pool, size_t size, void* owner, unsigned tag )
+{
+    if( tag >= CK_MAX_TAGS )
+        return NULL;
+    
+    owner = groupOf( owner );
+    void* alloc = allocSlim( pool, size, owner, tag );
+    if( pool->recBuf && alloc )
+    {
+        recOp( pool, CK_OP_ALLOC_SLIM );
+        recNum( pool, size );
+        recNum( pool, tag );
+        recAddr( pool, owner );
+        recAddr( pool, alloc );
+    }
+    
+    // a frozen owner won't be preserved to keep it
+    if( alloc && owner && owner != CK_TEMP && isFrozen( ptrToSlim( owner ) ) )
+        freezeRef( pool, alloc, ptrToFat( owner ), false );
+    return alloc;
+}
+
+static void*
+allocSlim( ck_Pool* pool, size_t size, void* owner, uint tag )
 {
     Size cSize = compressSize( size );
     if( size > decompressSize( cSize ) )
         // allocation too big
         return NULL;
     
+    // sizes that can't be encoded exactly are rounded up,
+    // so the bytes we account for here are the same ones
+    // 'doExpire' gives back
+    size = decompressSize( cSize );
+    
+    // roots are kept out of the slabs, they're rare and
+    // need the root list; and slab blocks have nowhere to
+    // keep a tag, so they all count as untagged
+    if( owner != NULL && tag == 0 &&
+        (pool->config.flags & CK_SLAB_SLIM) &&
+        size <= CLASS_SIZES[NUM_CLASSES-1] )
+        return slabAlloc( pool, size, owner );
+    
     size_t     tSize = size + sizeof(BlockSlim);
-    BlockSlim* block = allocRaw( pool, tSize );
+    BlockSlim* block = allocRaw( pool, tSize, owner, tag );
     if( block == NULL )
         return NULL;
 
@@ -285,10 +1468,17 @@ ck_allocSlim( ck_Pool* pool, size_t size, void* owner )
              cSize,
              false,
              (owner == NULL ) );
+    setTag( block, tag );
     
     if( block == NULL )
         return NULL;
     
+    if( owner == CK_TEMP )
+    {
+        block->eSlot = lastSlot( pool );
+        eInsert( pool, block );
+    }
+    else
     if( owner )
     {
         setOwner( block, ptrToFat( owner ) );
@@ -300,19 +1490,51 @@ ck_allocSlim( ck_Pool* pool, size_t size, void* owner )
     }
 
     pool->used += tSize;
+    pool->tags[tag].used += tSize;
     return slimToPtr( block );
 }
 
 void* 
 ck_allocFat( ck_Pool* pool, size_t size, void* owner )
+{
+    return ck_allocFatTagged( pool, size, owner, 0 );
+}
+
+void*
+ck_allocFatTagged( ck_Pool* pool, size_t size, void* owner, unsigned tag )
+{
+    if( tag >= CK_MAX_TAGS )
+        return NULL;
+    
+    owner = groupOf( owner );
+    void* alloc = allocFat( pool, size, owner, tag );
+    if( pool->recBuf && alloc )
+    {
+        recOp( pool, CK_OP_ALLOC_FAT );
+        recNum( pool, size );
+        recNum( pool, tag );
+        recAddr( pool, owner );
+        recAddr( pool, alloc );
+    }
+    
+    // same as above, it has nothing to walk yet
+    if( alloc && owner && owner != CK_TEMP && isFrozen( ptrToSlim( owner ) ) )
+        freezeRef( pool, alloc, ptrToFat( owner ), false );
+    return alloc;
+}
+
+static void*
+allocFat( ck_Pool* pool, size_t size, void* owner, uint tag )
 {
     Size cSize = compressSize( size );
     if( size > decompressSize( cSize ) )
         // allocation too big
         return NULL;
     
+    size = decompressSize( cSize );
+    
     size_t     tSize = size + sizeof(BlockFat);
-    BlockFat* block = allocRaw( pool, tSize );
+    BlockFat* block = allocRaw( pool, tSize, owner, tag );
     if( block == NULL )
         return NULL;
 
@@ -320,15 +1542,24 @@ ck_allocFat( ck_Pool* pool, size_t size, void* owner )
              cSize,
              true,
              (owner == NULL ) );
+    setTag( fatToSlim(block), tag );
     
     // if owner non-NULL then block is not root and
     // needs it's expiration slot set
+    // owner will be changed in 'setOwner' we just
+    // initialize to NULL here to prevent an 'if'
+    // from depending on an uninitialized value
+    block->owner = NULL;
+    block->owns  = 0;
+    block->level = 0;
+    if( owner == CK_TEMP )
+    {
+        block->slim.eSlot = lastSlot( pool );
+        eInsert( pool, fatToSlim(block) );
+    }
+    else
     if( owner )
     {
-        // owner will be changed in 'setOwner' we just
-        // initialize to NULL here to prevent an 'if'
-        // from depending on an uninitialized value
-        block->owner = NULL;
         setOwner( fatToSlim(block), ptrToFat( owner ) );
         eInsert( pool, fatToSlim(block) );
     }
@@ -341,483 +1572,4773 @@ ck_allocFat( ck_Pool* pool, size_t size, void* owner )
     setPreserveSlot( pool, block );
     pInsert( pool, block );
     pool->used += tSize;
+    pool->tags[tag].used += tSize;
     return fatToPtr( block );
 }
 
-void
-ck_ref( ck_Pool* pool, void* alloc, void* owner )
+void*
+ck_tryAllocSlim( ck_Pool* pool, size_t size, void* owner, ck_Shortfall* status )
 {
-    if( alloc == NULL || alloc == owner )
-        return;
+    ck_Shortfall dummy;
+    if( status == NULL )
+        status = &dummy;
+    status->bytes = 0;
+    status->ticks = 0;
     
-    BlockSlim* block = ptrToSlim( alloc );
-    if( isRoot( block ) )
-        return;
+    pool->shortfall = status;
+    void* alloc = ck_allocSlim( pool, size, owner );
+    pool->shortfall = NULL;
+    return alloc;
+}
+
+void*
+ck_tryAllocFat( ck_Pool* pool, size_t size, void* owner, ck_Shortfall* status )
+{
+    ck_Shortfall dummy;
+    if( status == NULL )
+        status = &dummy;
+    status->bytes = 0;
+    status->ticks = 0;
     
-    eExtract( block );
+    pool->shortfall = status;
+    void* alloc = ck_allocFat( pool, size, owner );
+    pool->shortfall = NULL;
+    return alloc;
+}
+
+void*
+ck_allocGroup( ck_Pool* pool, size_t const* sizes, size_t n, void* owner, void** out )
+{
+    if( n == 0 )
+        return NULL;
     
-    if( !owner )
-    {
-        toRoot( pool, block );
-        return;
-    }
+    // members are kept 8 byte aligned relative to the first
+    size_t total = sizes[0];
+    for( size_t i = 1 ; i < n ; i++ )
+        total = ((total + 7) & ~(size_t)7) + MEMBER_HEAD + sizes[i];
     
-    BlockFat* oBlock = ptrToFat( owner );
-    if( shouldRef( pool, oBlock, block ) )
+    void* group = ck_allocFat( pool, total, owner );
+    if( group == NULL )
+        return NULL;
+    
+    size_t at = 0;
+    out[0] = group;
+    for( size_t i = 1 ; i < n ; i++ )
     {
-        setOwner( block, oBlock );
-        setOrphan( block, false );
-        if( isOrphan( block ) )
-            doPreserve( pool, slimToFat(block) );
+        at = ((at + sizes[i-1] + 7) & ~(size_t)7) + MEMBER_HEAD;
+        out[i] = group + at;
+        
+        BlockSlim* member = ptrToSlim( out[i] );
+        setDesc( member, 0, false, false );
+        setOrphan( member, true );
+        member->eRef = (BlockSlim**)((void*)member - (void*)fatToSlim( ptrToFat( group ) ));
     }
-    
-    eInsert( pool, block );
+    return group;
 }
 
-void
-ck_unroot( ck_Pool* pool, void* alloc, void* owner )
+void*
+ck_allocSlimTTL( ck_Pool* pool, size_t size, uint64_t ttl )
 {
-    if( alloc == NULL || alloc == owner || owner == NULL )
-        return;
+    void* alloc = ck_allocSlim( pool, size, CK_TEMP );
+    if( alloc == NULL )
+        return NULL;
     
-    BlockSlim* block = ptrToSlim( alloc );
-    if( !isRoot( block ) )
-        return;
+    // CK_TEMP is as far as the cycle goes, the TTL can be
+    // shorter or longer than that
+    uint ticks = ttlTicks( pool, ttl );
+    if( isSlab( pool, alloc ) )
+    {
+        if( ticks < NUM_SLOTS )
+            slabMark( pool, alloc, (pool->clock + ticks) % NUM_SLOTS );
+        return alloc;
+    }
     
-    eExtract( block );
-    setOwner( block, ptrToFat( owner ) );
-    eInsert( pool, block );
+    BlockSlim* block = ptrToSlim( alloc );
+    eExtract( pool, block );
+    scheduleIn( pool, block, ticks );
+    return alloc;
 }
 
 void
-ck_cycle( ck_Pool* pool )
+ck_refTTL( ck_Pool* pool, void* alloc, uint64_t ttl )
 {
-    uint ticks = NUM_SLOTS;
-    while( ticks-- )
-        ck_tick( pool );
+    if( alloc != NULL )
+        keepFor( pool, alloc, ttlTicks( pool, ttl ) );
 }
 
-void
-ck_tick( ck_Pool* pool )
+void*
+ck_internSlim( ck_Pool* pool, void const* data, size_t size, void* owner )
 {
-    Slot slot = pool->clock % NUM_SLOTS;
+    // the hash is never zero, which is the tables' empty key
+    void* hash = (void*)(uintptr_t)hashBytes( data, size );
+    void* old  = tableGet( &pool->interns, hash );
     
-    BlockFat** pSlot = &pool->pSchedule[slot];
-    while( *pSlot )
-        doPreserve( pool, *pSlot );
+    // the hash covers the size but may still collide with a
+    // block of another size, so that's checked before the bytes
+    if( old != NULL &&
+        (size_t)(uintptr_t)tableGet( &pool->internSize, ptrToSlim( old ) ) == size &&
+        memcmp( old, data, size ) == 0 )
+    {
+        if( owner == CK_TEMP )
+            tempRef( pool, old );
+        else
+            ck_ref( pool, old, owner );
+        return old;
+    }
     
-    BlockSlim** eSlot = &pool->eSchedule[slot];
-    while( *eSlot )
-        doExpire( pool, *eSlot );
+    void* alloc = ck_allocSlim( pool, size, owner );
+    if( alloc == NULL )
+        return NULL;
+    memcpy( alloc, data, size );
     
-    pool->clock++;
+    // a different blob with the same hash keeps its entry,
+    // this one just isn't interned; same if the tables
+    // can't grow
+    if( old == NULL && tablePut( pool, &pool->interns, hash, alloc ) )
+    {
+        BlockSlim* block = ptrToSlim( alloc );
+        if( !tablePut( pool, &pool->internOf, block, hash ) ||
+            !tablePut( pool, &pool->internSize, block, (void*)(uintptr_t)size ) )
+        {
+            tableDel( &pool->internOf, block );
+            tableDel( &pool->interns, hash );
+        }
+    }
+    return alloc;
 }
 
 void
-ck_step( ck_Pool* pool )
+ck_ref( ck_Pool* pool, void* alloc, void* owner )
 {
-    Slot slot = pool->clock % NUM_SLOTS;
-    BlockFat** pSlot = &pool->pSchedule[slot];
-    BlockSlim** eSlot = &pool->eSchedule[slot];
+    if( alloc == NULL )
+        return;
     
-    if( *pSlot )
-        doPreserve( pool, *pSlot );
-    else
-    if( *eSlot )
-        doExpire( pool, *eSlot );
-    else
-        pool->clock++;
-}
-
+    // group members stand for their group
+    bool slab = isSlab( pool, alloc );
+    if( !slab )
+        alloc = groupOf( alloc );
+    owner = groupOf( owner );
+    if( alloc == owner )
+        return;
+    
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_REF );
+        recAddr( pool, alloc );
+        recAddr( pool, owner );
+    }
+    
+    // a full collection only wants to know what's reachable
+    if( pool->marking )
+    {
+        markRef( pool, alloc );
+        return;
+    }
+    
+    // a frozen block takes whatever it refs along with it
+    if( owner != NULL && isFrozen( ptrToSlim( owner ) ) )
+    {
+        freezeRef( pool, alloc, ptrToFat( owner ), true );
+        return;
+    }
+    
+    if( slab )
+    {
+        slabRef( pool, alloc, owner );
+        return;
+    }
+    
+    BlockSlim* block = ptrToSlim( alloc );
+    if( isRoot( block ) )
+    {
+        // rooting a frozen root again undoes an unroot
+        if( owner == NULL && isFrozen( block ) && pool->frozen[block->eSlot].root == block )
+            pool->frozen[block->eSlot].rooted = true;
+        return;
+    }
+    
+    if( owner != NULL && isOrphan( ptrToSlim( owner ) ) )
+    {
+        orphanRef( pool, ptrToFat( owner ), block );
+        return;
+    }
+    
+    eExtract( pool, block );
+    
+    if( !owner )
+    {
+        toRoot( pool, block );
+        return;
+    }
+    
+    BlockFat* oBlock    = ptrToFat( owner );
+    bool      wasOrphan = false;
+    if( shouldRef( pool, oBlock, block ) )
+    {
+        wasOrphan = isOrphan( block );
+        setOwner( block, oBlock );
+        setOrphan( block, false );
+    }
+    
+    eInsert( pool, block );
+    
+    // an orphaned block that's referenced from outside of
+    // its cycle needs to start preserving again, it has to
+    // be back in the schedule first since the preservation
+    // may well come back around and ref it again
+    if( wasOrphan )
+        doPreserve( pool, slimToFat(block) );
+}
+
+void*
+ck_refMove( ck_Pool* pool, void* alloc, void* owner )
+{
+    if( alloc == NULL )
+        return NULL;
+    
+    // the caller may still have the old address of either,
+    // slab blocks are never moved though
+    if( owner != NULL )
+        owner = fatToPtr( slimToFat( resolveMoved( fatToSlim( ptrToFat( groupOf( owner ) ) ) ) ) );
+    if( isSlab( pool, alloc ) )
+    {
+        ck_ref( pool, alloc, owner );
+        return alloc;
+    }
+    
+    // a group moves as a whole, members keep their offset
+    void*      group = groupOf( alloc );
+    size_t     at    = alloc - group;
+    BlockSlim* block = resolveMoved( ptrToSlim( group ) );
+    if( slimToPtr( block ) == owner )
+        return owner + at;
+    
+    if( (pool->config.flags & CK_COMPACT) && canMove( pool, block ) )
+        block = moveBlock( pool, block );
+    
+    // the trace only needs to know the address changed, the
+    // ref itself is recorded by 'ck_ref'
+    if( pool->recBuf && slimToPtr( block ) != group )
+    {
+        recOp( pool, CK_OP_MOVE );
+        recAddr( pool, group );
+        recAddr( pool, slimToPtr( block ) );
+    }
+    
+    // blocks owned by a moved block still name the old
+    // copy, they're handed to the new one as they come by
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat( block );
+        if( fat->owner != NULL && hasFlag( fatToSlim( fat->owner ), FLAG_MOVED ) )
+        {
+            BlockFat* to = slimToFat( resolveMoved( fatToSlim( fat->owner ) ) );
+            fat->owner->owns--;
+            fat->owner = to;
+            to->owns++;
+        }
+    }
+    
+    alloc = slimToPtr( block );
+    ck_ref( pool, alloc, owner );
+    return alloc + at;
+}
+
 void
-ck_reserve( ck_Pool* pool, size_t amount )
+ck_unroot( ck_Pool* pool, void* alloc, void* owner )
+{
+    if( alloc == NULL )
+        return;
+    
+    bool slab = isSlab( pool, alloc );
+    if( !slab )
+        alloc = groupOf( alloc );
+    owner = groupOf( owner );
+    if( alloc == owner )
+        return;
+    
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_UNROOT );
+        recAddr( pool, alloc );
+        recAddr( pool, owner );
+    }
+    
+    // see below
+    if( slab )
+    {
+        if( *slabSlot( alloc ) == SLOT_NONE )
+            slabMark( pool, alloc, (pool->clock + NUM_SLOTS - 1) % NUM_SLOTS );
+        return;
+    }
+    
+    BlockSlim* block = ptrToSlim( alloc );
+    if( !isRoot( block ) )
+        return;
+    
+    // a frozen root stays put until it's thawed
+    if( isFrozen( block ) )
+    {
+        if( pool->frozen[block->eSlot].root == block )
+            pool->frozen[block->eSlot].rooted = false;
+        return;
+    }
+    
+    eExtract( pool, block );
+    setRoot( block, false );
+    giveCycle( pool, block );
+}
+
+int
+ck_freeze( ck_Pool* pool, void* root )
+{
+    if( root == NULL || isSlab( pool, root ) )
+        return -1;
+    
+    root = groupOf( root );
+    BlockSlim* block = ptrToSlim( root );
+    uint       set   = 0;
+    while( set < FROZEN_SETS && pool->frozen[set].root != NULL )
+        set++;
+    if( !isRoot( block ) || isFrozen( block ) || set == FROZEN_SETS )
+        return -1;
+    
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_FREEZE );
+        recAddr( pool, root );
+    }
+    
+    Frozen* frozen  = &pool->frozen[set];
+    frozen->root    = block;
+    frozen->rooted  = true;
+    frozen->fatTail = &frozen->fats;
+    eExtract( pool, block );
+    freezeBlock( pool, block, frozen );
+    if( isFat( block ) )
+        freezeWalk( pool, frozen, slimToFat( block ) );
+    return 0;
+}
+
+int
+ck_thaw( ck_Pool* pool, void* root )
+{
+    if( root == NULL || isSlab( pool, root ) )
+        return -1;
+    
+    root = groupOf( root );
+    BlockSlim* block = ptrToSlim( root );
+    if( !isFrozen( block ) || pool->frozen[block->eSlot].root != block )
+        return -1;
+    
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_THAW );
+        recAddr( pool, root );
+    }
+    
+    // the set's blocks may be held from outside of it, and
+    // the holders' refs were ignored; so, like an unrooted
+    // block, each gets a cycle for its holders to come back
+    // to it, and the fat ones are preserved in that cycle
+    Frozen* frozen = &pool->frozen[block->eSlot];
+    while( frozen->blocks )
+    {
+        BlockSlim* iter = frozen->blocks;
+        eExtract( pool, iter );
+        if( iter == frozen->root && frozen->rooted )
+        {
+            toRoot( pool, iter );
+        }
+        else
+        {
+            setRoot( iter, false );
+            giveCycle( pool, iter );
+        }
+        
+        if( isFat( iter ) )
+        {
+            BlockFat* fat = slimToFat( iter );
+            pExtract( fat );
+            fat->cycleCD = CK_CYCLE_DETECT_COUNTDOWN;
+            setPreserveSlot( pool, fat );
+            pInsert( pool, fat );
+        }
+    }
+    for( size_t i = 0 ; i < frozen->nSlabs ; i++ )
+        slabMark( pool, frozen->slabs[i], (pool->clock + NUM_SLOTS - 1) % NUM_SLOTS );
+    
+    pool->config.alloc( pool->config.context, frozen->slabs, 0 );
+    memset( frozen, 0, sizeof(*frozen) );
+    return 0;
+}
+
+int
+ck_refRemote( ck_Pool* pool, void* alloc, ck_Pool* from, void* owner )
+{
+    if( alloc == NULL )
+        return 0;
+    if( owner == NULL || owner == CK_TEMP )
+        return -1;
+    if( pool == from )
+    {
+        ck_ref( pool, alloc, owner );
+        return 0;
+    }
+    
+    // only 'from' is ours to look at here, the block is
+    // sorted out by its own pool when the entry's drained
+    Remote* entry = from->spare;
+    if( entry == NULL )
+    {
+        from->spare = atomic_exchange( &from->spent, NULL );
+        entry = from->spare;
+    }
+    if( entry != NULL )
+        from->spare = entry->next;
+    else
+        entry = from->config.alloc( from->config.context, NULL, sizeof(Remote) );
+    if( entry == NULL )
+        return -1;
+    
+    BlockFat* oBlock = slimToFat( resolveMoved( fatToSlim( ptrToFat( groupOf( owner ) ) ) ) );
+    entry->alloc = alloc;
+    entry->home  = from;
+    entry->ticks = dueIn( from, oBlock->pSlot, oBlock->pCycle,
+                          hasFlag( &oBlock->slim, FLAG_PFAR ) );
+    pushRemote( &pool->inbox, entry );
+    return 0;
+}
+
+void*
+ck_pushRoot( ck_Pool* pool, void* alloc )
+{
+    if( alloc == NULL )
+        return NULL;
+    
+    // the stack holds the group, the caller gets back the
+    // member it pushed
+    void* pushed = alloc;
+    if( !isSlab( pool, alloc ) )
+        alloc = groupOf( alloc );
+    
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_PUSH_ROOT );
+        recAddr( pool, alloc );
+    }
+    
+    if( pool->depth == pool->stackCap )
+    {
+        size_t cap   = pool->stackCap ? pool->stackCap * 2 : 64;
+        void** stack = pool->config.alloc( pool->config.context,
+                                           pool->stack,
+                                           cap * sizeof(*stack) );
+        if( stack == NULL )
+            return NULL;
+        pool->stack    = stack;
+        pool->stackCap = cap;
+    }
+    
+    // it might be due in the middle of this tick, every
+    // other slot is handled by 'keepStack'
+    pool->stack[pool->depth++] = alloc;
+    keepStacked( pool, alloc );
+    return pushed;
+}
+
+void
+ck_popRoot( ck_Pool* pool )
+{
+    if( pool->recBuf )
+        recOp( pool, CK_OP_POP_ROOT );
+    if( pool->depth > 0 )
+        pool->depth--;
+}
+
+size_t
+ck_scopeMark( ck_Pool* pool )
+{
+    return pool->depth;
+}
+
+void
+ck_scopeRelease( ck_Pool* pool, size_t mark )
+{
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_SCOPE_RELEASE );
+        recNum( pool, mark );
+    }
+    if( mark < pool->depth )
+        pool->depth = mark;
+}
+
+int
+ck_addStack( ck_Pool* pool, void const* lo, void const* hi )
+{
+    if( pool->nScans == pool->capScans )
+    {
+        size_t cap   = pool->capScans ? pool->capScans * 2 : 8;
+        Range* scans = pool->config.alloc( pool->config.context,
+                                           pool->scans,
+                                           cap * sizeof(*scans) );
+        if( scans == NULL )
+            return -1;
+        pool->scans    = scans;
+        pool->capScans = cap;
+    }
+    
+    pool->scans[pool->nScans].lo = lo;
+    pool->scans[pool->nScans].hi = hi;
+    pool->nScans++;
+    return 0;
+}
+
+void
+ck_removeStack( ck_Pool* pool, void const* hi )
+{
+    for( size_t i = 0 ; i < pool->nScans ; i++ )
+    {
+        if( pool->scans[i].hi == hi )
+        {
+            pool->scans[i] = pool->scans[--pool->nScans];
+            return;
+        }
+    }
+}
+
+void
+ck_cycle( ck_Pool* pool )
+{
+    if( pool->recBuf )
+        recOp( pool, CK_OP_CYCLE );
+    
+    size_t ticks = NUM_SLOTS;
+    while( ticks > 0 )
+    {
+        ticks -= doAdvance( pool, ticks );
+        if( ticks > 0 )
+        {
+            doTick( pool );
+            ticks--;
+        }
+    }
+}
+
+void
+ck_tick( ck_Pool* pool )
+{
+    if( pool->recBuf )
+        recOp( pool, CK_OP_TICK );
+    doTick( pool );
+}
+
+void
+ck_step( ck_Pool* pool )
+{
+    if( pool->recBuf )
+        recOp( pool, CK_OP_STEP );
+    
+    drainRemote( pool );
+    Slot slot = pool->clock % NUM_SLOTS;
+    BlockFat** pSlot = &pool->pSchedule[slot];
+    BlockSlim** eSlot = &pool->eSchedule[slot];
+    
+    if( *pSlot )
+        doPreserve( pool, *pSlot );
+    else
+    if( *eSlot )
+    {
+        if( !keepScanned( pool, *eSlot ) )
+            doExpire( pool, *eSlot );
+    }
+    else
+    {
+        endTick( pool, slot );
+        doAdvance( pool, NUM_SLOTS );
+    }
+}
+
+void
+ck_useTime( ck_Pool* pool, ck_Time now, uint64_t tickTime )
+{
+    pool->timeNow   = now ? now : monotonicNow;
+    pool->tickTime  = tickTime ? tickTime : 1;
+    pool->timeBase  = pool->timeNow( pool->config.context );
+    pool->clockBase = pool->clock;
+}
+
+size_t
+ck_catchUp( ck_Pool* pool )
+{
+    if( pool->timeNow == NULL )
+        return 0;
+    
+    // the clock can be ahead if it's been ticked by hand,
+    // then there's nothing to do until the time catches up
+    uint   target = timeTarget( pool );
+    size_t ticks  = 0;
+    while( (int)(target - pool->clock) > 0 )
+    {
+        uint   left    = target - pool->clock;
+        size_t skipped = ck_advance( pool, left );
+        ticks += skipped;
+        if( skipped < left )
+        {
+            ck_tick( pool );
+            ticks++;
+        }
+    }
+    return ticks;
+}
+
+int
+ck_getTimerFd( ck_Pool* pool )
+{
+#if CK_HAVE_TIMERFD
+    if( pool->timerFd < 0 )
+    {
+        pool->timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+        armTimer( pool );
+    }
+    return pool->timerFd;
+#else
+    return -1;
+#endif
+}
+
+size_t
+ck_onIdle( ck_Pool* pool, uint64_t deadline )
+{
+#if CK_HAVE_TIMERFD
+    // the timer stays readable until it's read
+    uint64_t fired;
+    if( pool->timerFd >= 0 && read( pool->timerFd, &fired, sizeof(fired) ) < 0 )
+        fired = 0;
+#endif
+    
+    // ticks that are due by the time come first, then the
+    // ones ahead of it that'd relieve the pressure
+    ck_Time now   = pool->timeNow ? pool->timeNow : monotonicNow;
+    uint    until = timeTarget( pool );
+    uint    ahead = idleAhead( pool );
+    if( ahead > 0 && (int)(pool->clock + ahead - until) > 0 )
+        until = pool->clock + ahead;
+    
+    size_t steps = 0;
+    while( (int)(until - pool->clock) > 0 && now( pool->config.context ) < deadline )
+    {
+        idleStep( pool, until );
+        steps++;
+    }
+    armTimer( pool );
+    return steps;
+}
+
+size_t
+ck_advance( ck_Pool* pool, size_t maxTicks )
+{
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_ADVANCE );
+        recNum( pool, maxTicks );
+    }
+    return doAdvance( pool, maxTicks );
+}
+
+size_t
+ck_nextEvents( ck_Pool* pool, ck_Event* event, void** allocs, size_t cap )
+{
+    // the caller's done with the last expired blocks by now
+    while( pool->expiring )
+    {
+        BlockSlim* block = pool->expiring;
+        pool->expiring = block->eNext;
+        freeBlock( pool, block );
+    }
+    pool->eventBlock = NULL;
+    drainRemote( pool );
+    
+    Slot slot = pool->clock % NUM_SLOTS;
+    BlockFat** pSlot = &pool->pSchedule[slot];
+    BlockSlim** eSlot = &pool->eSchedule[slot];
+    size_t count = 0;
+    
+    // the whole batch is rescheduled before any of their
+    // references are refreshed; a block whose expiration gets
+    // pushed back by an earlier one in the batch just ends up
+    // preserving a little early, which is always safe
+    if( *pSlot )
+    {
+        // with compaction the block being preserved has to stay
+        // put until the caller's done, so only one goes at a time
+        if( pool->config.flags & CK_COMPACT )
+        {
+            cap = 1;
+            pool->eventBlock = *pSlot;
+        }
+        
+        *event = CK_EVENT_PRESERVE;
+        while( *pSlot && count < cap )
+        {
+            BlockFat* block = *pSlot;
+            schedPreserve( pool, block );
+            allocs[count++] = fatToPtr( block );
+            if( pool->recBuf )
+            {
+                recOp( pool, CK_OP_PRESERVE );
+                recAddr( pool, fatToPtr( block ) );
+            }
+        }
+        return count;
+    }
+    
+    // deferred blocks go straight to the finalization
+    // queue, so they don't make an event
+    while( *eSlot && count < cap )
+    {
+        BlockSlim* block = *eSlot;
+        if( keepScanned( pool, block ) )
+            continue;
+        if( unlinkExpired( pool, block ) )
+        {
+            block->eNext   = pool->expiring;
+            pool->expiring = block;
+            allocs[count++] = slimToPtr( block );
+        }
+    }
+    if( count > 0 )
+    {
+        *event = CK_EVENT_EXPIRE;
+        return count;
+    }
+    
+    drainFinalized( pool );
+    endTick( pool, slot );
+    *event = CK_EVENT_TICK;
+    if( pool->recBuf )
+        recOp( pool, CK_OP_TICK );
+    return 0;
+}
+
+void
+ck_reserve( ck_Pool* pool, size_t amount )
+{
+    ck_reserveTagged( pool, amount, 0 );
+}
+
+void
+ck_reserveTagged( ck_Pool* pool, size_t amount, unsigned tag )
+{
+    if( tag >= CK_MAX_TAGS )
+        return;
+    
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_RESERVE );
+        recNum( pool, amount );
+        recNum( pool, tag );
+    }
+    collectFor( pool, amount, tag );
+}
+
+size_t
+ck_collectAll( ck_Pool* pool )
+{
+    if( pool->recBuf )
+        recOp( pool, CK_OP_COLLECT_ALL );
+    return collectAll( pool );
+}
+
+size_t
+ck_runFinalizers( ck_Pool* pool, size_t budget )
+{
+    size_t count = 0;
+    while( count < budget )
+    {
+        while( atomic_flag_test_and_set_explicit( &pool->finalLock,
+                                                  memory_order_acquire ) )
+            ;
+        BlockSlim* block = pool->finalHead;
+        if( block != NULL )
+        {
+            pool->finalHead = block->eNext;
+            if( pool->finalHead == NULL )
+                pool->finalTail = NULL;
+        }
+        atomic_flag_clear_explicit( &pool->finalLock, memory_order_release );
+        
+        if( block == NULL )
+            break;
+        
+        if( pool->config.expire )
+            pool->config.expire( pool->config.context, slimToPtr( block ) );
+        
+        // hand the block back to the pool's thread
+        BlockSlim* head = atomic_load_explicit( &pool->finalized,
+                                                memory_order_relaxed );
+        do
+        {
+            block->eNext = head;
+        } while( !atomic_compare_exchange_weak_explicit( &pool->finalized,
+                                                         &head,
+                                                         block,
+                                                         memory_order_release,
+                                                         memory_order_relaxed ) );
+        count++;
+    }
+    return count;
+}
+
+unsigned
+ck_forecast( ck_Pool* pool, size_t bytes )
+{
+    return forecast( pool, bytes );
+}
+
+size_t
+ck_pending( ck_Pool* pool )
+{
+    return pool->pending;
+}
+
+size_t
+ck_avail( ck_Pool* pool )
+{
+    return pool->config.quota - pool->used;
+}
+
+size_t
+ck_used( ck_Pool* pool )
+{
+    return pool->used;
+}
+
+size_t
+ck_blockSize( size_t size, int fat )
+{
+    // the same rounding as the allocators
+    Size cSize = compressSize( size );
+    if( size > decompressSize( cSize ) )
+        return SIZE_MAX;
+    return decompressSize( cSize ) + (fat ? sizeof(BlockFat) : sizeof(BlockSlim));
+}
+
+void
+ck_setTagQuota( ck_Pool* pool, unsigned tag, size_t quota )
+{
+    if( tag < CK_MAX_TAGS )
+        pool->tags[tag].quota = quota;
+}
+
+size_t
+ck_tagUsed( ck_Pool* pool, unsigned tag )
+{
+    if( tag >= CK_MAX_TAGS )
+        return 0;
+    return pool->tags[tag].used;
+}
+
+ck_Weak*
+ck_makeWeak( ck_Pool* pool, void* alloc )
+{
+    if( alloc == NULL )
+        return NULL;
+    if( !isSlab( pool, alloc ) )
+        alloc = groupOf( alloc );
+    
+    ck_Weak* weak = pool->config.alloc( pool->config.context,
+                                        NULL,
+                                        sizeof(*weak) );
+    if( weak == NULL )
+        return NULL;
+    
+    // slab blocks don't have flags, they just check the
+    // table when they expire; the key is never dereferenced
+    BlockSlim* block = ptrToSlim( alloc );
+    weak->alloc = alloc;
+    weak->chain = tableGet( &pool->weakTable, block );
+    if( !tablePut( pool, &pool->weakTable, block, weak ) )
+    {
+        pool->config.alloc( pool->config.context, weak, 0 );
+        return NULL;
+    }
+    if( !isSlab( pool, alloc ) )
+        setFlag( block, FLAG_WEAK, true );
+    
+    weak->next = pool->weaks;
+    weak->ref  = &pool->weaks;
+    if( weak->next != NULL )
+        weak->next->ref = &weak->next;
+    pool->weaks = weak;
+    
+    return weak;
+}
+
+void*
+ck_getWeak( ck_Pool* pool, ck_Weak* weak )
+{
+    // the handle has everything, the pool's just for symmetry
+    (void)pool;
+    return weak->alloc;
+}
+
+void
+ck_freeWeak( ck_Pool* pool, ck_Weak* weak )
+{
+    // if the block is still alive then we need to take
+    // the handle out of its chain
+    if( weak->alloc != NULL )
+    {
+        BlockSlim* block = ptrToSlim( weak->alloc );
+        ck_Weak*   head  = tableGet( &pool->weakTable, block );
+        
+        if( head == weak )
+        {
+            if( weak->chain != NULL )
+                tablePut( pool, &pool->weakTable, block, weak->chain );
+            else
+            {
+                tableDel( &pool->weakTable, block );
+                if( !isSlab( pool, weak->alloc ) )
+                    setFlag( block, FLAG_WEAK, false );
+            }
+        }
+        else
+        {
+            ck_Weak** wPtr;
+            for( wPtr = &head->chain ; *wPtr != weak ; wPtr = &(*wPtr)->chain )
+                ;
+            *wPtr = weak->chain;
+        }
+    }
+    
+    *weak->ref = weak->next;
+    if( weak->next != NULL )
+        weak->next->ref = weak->ref;
+    pool->config.alloc( pool->config.context, weak, 0 );
+}
+
+size_t
+ck_resident( ck_Pool* pool )
+{
+    if( pool->config.flags & CK_REGION_HEAP )
+        return pool->heap.resident;
+    return pool->used;
+}
+
+int
+ck_savePool( ck_Pool* pool, int fd )
+{
+#if CK_HAVE_MMAP
+    // without the region heap we don't know where the
+    // blocks are, so there's nothing to write
+    if( !(pool->config.flags & CK_REGION_HEAP) )
+        return -1;
+    
+    // nothing in the image can be waiting on the caller
+    while( pool->expiring )
+    {
+        BlockSlim* block = pool->expiring;
+        pool->expiring = block->eNext;
+        freeBlock( pool, block );
+    }
+    ck_runFinalizers( pool, SIZE_MAX );
+    drainFinalized( pool );
+    drainRemote( pool );
+    reclaim( pool, true );
+    pool->eventBlock = NULL;
+    
+    Heap*  heap  = &pool->heap;
+    size_t nMaps = 0;
+    for( Chunk* chunk = heap->chunks ; chunk ; chunk = chunk->next )
+        nMaps++;
+    for( Page* page = heap->large ; page ; page = page->next )
+        nMaps++;
+    
+    ImageMap* maps = pool->config.alloc( pool->config.context,
+                                         NULL,
+                                         nMaps * sizeof(*maps) + 1 );
+    if( maps == NULL )
+        return -1;
+    
+    // frozen sets' slab lists go after the header and the
+    // map list, then the mappings, each at an offset that can
+    // be mapped straight back in
+    size_t nSlabs = 0;
+    for( uint i = 0 ; i < FROZEN_SETS ; i++ )
+        nSlabs += pool->frozen[i].nSlabs;
+    uint64_t offset = sizeof(Image) + nMaps * sizeof(*maps) + nSlabs * sizeof(void*);
+    offset = (offset + REGION_PAGE - 1) & ~(uint64_t)(REGION_PAGE - 1);
+    
+    size_t i = 0;
+    for( Chunk* chunk = heap->chunks ; chunk ; chunk = chunk->next, i++ )
+    {
+        memset( &maps[i], 0, sizeof(maps[i]) );
+        maps[i].addr   = chunk->base;
+        maps[i].size   = REGION_CHUNK;
+        maps[i].offset = offset;
+        memcpy( maps[i].free, chunk->free, sizeof(chunk->free) );
+        offset += REGION_CHUNK;
+    }
+    for( Page* page = heap->large ; page ; page = page->next, i++ )
+    {
+        memset( &maps[i], 0, sizeof(maps[i]) );
+        maps[i].addr   = page;
+        maps[i].size   = (page->span + REGION_PAGE - 1) & ~(size_t)(REGION_PAGE - 1);
+        maps[i].offset = offset;
+        maps[i].large  = true;
+        offset += maps[i].size;
+    }
+    
+    Image image;
+    memset( &image, 0, sizeof(image) );
+    memcpy( image.magic, "clokimg", 8 );
+    imageLayout( image.layout );
+    image.flags   = pool->config.flags;
+    image.clock   = pool->clock;
+    image.rand    = pool->rand;
+    image.used    = pool->used;
+    image.nMaps   = nMaps;
+    image.roots   = pool->roots;
+    memcpy( image.eSchedule, pool->eSchedule, sizeof(image.eSchedule) );
+    memcpy( image.pSchedule, pool->pSchedule, sizeof(image.pSchedule) );
+    memcpy( image.tombs, pool->tombs, sizeof(image.tombs) );
+    memcpy( image.forwards, pool->forwards, sizeof(image.forwards) );
+    memcpy( image.tags, pool->tags, sizeof(image.tags) );
+    memcpy( image.eFar, pool->eFar, sizeof(image.eFar) );
+    memcpy( image.pFar, pool->pFar, sizeof(image.pFar) );
+    memcpy( image.tombsFar, pool->tombsFar, sizeof(image.tombsFar) );
+    memcpy( image.eBytes, pool->eBytes, sizeof(image.eBytes) );
+    memcpy( image.eFarBytes, pool->eFarBytes, sizeof(image.eFarBytes) );
+    memcpy( image.fwdBytes, pool->fwdBytes, sizeof(image.fwdBytes) );
+    memcpy( image.frozen, pool->frozen, sizeof(image.frozen) );
+    
+    bool ok = writeAll( fd, &image, sizeof(image), 0 ) &&
+              writeAll( fd, maps, nMaps * sizeof(*maps), sizeof(image) );
+    
+    uint64_t at = sizeof(image) + nMaps * sizeof(*maps);
+    for( uint i = 0 ; i < FROZEN_SETS && ok ; i++ )
+    {
+        ok = writeAll( fd, pool->frozen[i].slabs, pool->frozen[i].nSlabs * sizeof(void*), at );
+        at += pool->frozen[i].nSlabs * sizeof(void*);
+    }
+    
+    // only the pages in use are written, the rest of each
+    // chunk is left as a hole that reads back as zeros
+    for( i = 0 ; i < nMaps && ok ; i++ )
+    {
+        if( maps[i].large )
+        {
+            ok = writeAll( fd, maps[i].addr, ((Page*)maps[i].addr)->span, maps[i].offset );
+            continue;
+        }
+        for( uint idx = 0 ; idx < CHUNK_PAGES && ok ; idx++ )
+        {
+            if( maps[i].free[idx / 64] & (uint64_t)1 << idx % 64 )
+                continue;
+            ok = writeAll( fd,
+                           maps[i].addr + idx * REGION_PAGE,
+                           REGION_PAGE,
+                           maps[i].offset + idx * REGION_PAGE );
+        }
+    }
+    if( ok )
+        ok = ftruncate( fd, offset ) == 0;
+    
+    pool->config.alloc( pool->config.context, maps, 0 );
+    return ok ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+ck_Pool*
+ck_loadPool( ck_Config const* config, int fd )
+{
+#if CK_HAVE_MMAP
+    Image image;
+    uint  layout[6];
+    imageLayout( layout );
+    if( !readAll( fd, &image, sizeof(image), 0 ) ||
+        memcmp( image.magic, "clokimg", 8 ) ||
+        memcmp( image.layout, layout, sizeof(layout) ) )
+        return NULL;
+    
+    ImageMap* maps = config->alloc( config->context,
+                                    NULL,
+                                    image.nMaps * sizeof(*maps) + 1 );
+    if( maps == NULL )
+        return NULL;
+    if( !readAll( fd, maps, image.nMaps * sizeof(*maps), sizeof(image) ) )
+    {
+        config->alloc( config->context, maps, 0 );
+        return NULL;
+    }
+    
+    // the image goes back where it was if nothing else is
+    // there, then the only pointers that need fixing are the
+    // ones into the pool itself; otherwise everything moves
+    // by the same amount, but only the user knows where their
+    // own pointers are, so that takes the 'restore' hook
+    void* base = imageReserve( maps, image.nMaps, true );
+    if( base == NULL && config->restore != NULL )
+        base = imageReserve( maps, image.nMaps, false );
+    if( base == NULL )
+    {
+        config->alloc( config->context, maps, 0 );
+        return NULL;
+    }
+    
+    ptrdiff_t delta = 0;
+    if( image.nMaps > 0 )
+    {
+        void* low = maps[0].addr;
+        for( size_t i = 1 ; i < image.nMaps ; i++ )
+        {
+            if( maps[i].addr < low )
+                low = maps[i].addr;
+        }
+        low   = (void*)((uintptr_t)low & ~(uintptr_t)(REGION_CHUNK - 1));
+        delta = base - low;
+    }
+    
+    // the pages are mapped copy on write, so nothing is
+    // read until it's touched
+    bool ok = true;
+    for( size_t i = 0 ; i < image.nMaps ; i++ )
+    {
+        void* addr = mmap( maps[i].addr + delta, maps[i].size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_FIXED,
+                           fd, maps[i].offset );
+        ok = ok && addr != MAP_FAILED;
+    }
+    
+    ck_Config copy = *config;
+    copy.flags |= image.flags & (CK_REGION_HEAP | CK_COMPACT | CK_SLAB_SLIM | CK_ADAPTIVE);
+    ck_Pool* pool = ok ? ck_makePool( &copy ) : NULL;
+    if( pool == NULL )
+    {
+        for( size_t i = 0 ; i < image.nMaps ; i++ )
+            munmap( maps[i].addr + delta, maps[i].size );
+        config->alloc( config->context, maps, 0 );
+        return NULL;
+    }
+    
+    pool->clock   = image.clock;
+    pool->rand    = image.rand;
+    pool->used    = image.used;
+    pool->roots   = shift( image.roots, delta );
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+    {
+        pool->eSchedule[i] = shift( image.eSchedule[i], delta );
+        pool->pSchedule[i] = shift( image.pSchedule[i], delta );
+        pool->tombs[i]     = shift( image.tombs[i], delta );
+    }
+    for( uint i = 0 ; i < FORWARD_CYCLES ; i++ )
+        pool->forwards[i] = shift( image.forwards[i], delta );
+    memcpy( pool->tags, image.tags, sizeof(pool->tags) );
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+    {
+        pool->eFar[i]     = shift( image.eFar[i], delta );
+        pool->pFar[i]     = shift( image.pFar[i], delta );
+        pool->tombsFar[i] = shift( image.tombsFar[i], delta );
+    }
+    memcpy( pool->eBytes, image.eBytes, sizeof(pool->eBytes) );
+    memcpy( pool->eFarBytes, image.eFarBytes, sizeof(pool->eFarBytes) );
+    memcpy( pool->fwdBytes, image.fwdBytes, sizeof(pool->fwdBytes) );
+    
+    // a slab list that can't be read back leaves its blocks
+    // rooted for good, same as when it can't grow
+    uint64_t at = sizeof(image) + image.nMaps * sizeof(*maps);
+    for( uint i = 0 ; i < FROZEN_SETS ; i++ )
+    {
+        Frozen* frozen = &pool->frozen[i];
+        Frozen* saved  = &image.frozen[i];
+        frozen->root    = shift( saved->root, delta );
+        frozen->blocks  = shift( saved->blocks, delta );
+        frozen->fats    = shift( saved->fats, delta );
+        frozen->fatTail = saved->fats ? shift( saved->fatTail, delta ) : &frozen->fats;
+        frozen->rooted  = saved->rooted;
+        
+        size_t size = saved->nSlabs * sizeof(void*);
+        if( saved->nSlabs > 0 )
+            frozen->slabs = config->alloc( config->context, NULL, size );
+        if( frozen->slabs != NULL && readAll( fd, frozen->slabs, size, at ) )
+        {
+            frozen->nSlabs   = saved->nSlabs;
+            frozen->capSlabs = saved->nSlabs;
+            for( size_t j = 0 ; j < frozen->nSlabs ; j++ )
+                frozen->slabs[j] = shift( frozen->slabs[j], delta );
+        }
+        at += size;
+    }
+    
+    // the image doesn't say which slots are empty, their
+    // first ticks will find out
+    memset( pool->slotMask, 0xff, sizeof(pool->slotMask) );
+    
+    imageAdopt( pool, maps, image.nMaps, delta );
+    imageRelink( pool, delta );
+    if( pool->config.restore )
+        imageRestore( pool, delta );
+    
+    config->alloc( config->context, maps, 0 );
+    return pool;
+#else
+    return NULL;
+#endif
+}
+
+static _Thread_local uint readerHint;
+
+unsigned
+ck_readEnter( ck_Pool* pool )
+{
+    atomic_store( &pool->readersSeen, true );
+    
+    // threads tend to get the same slot back, so they
+    // don't have to search for one
+    for( uint idx = readerHint ;; idx = (idx + 1) % READER_SLOTS )
+    {
+        Reader*  reader = &pool->readers[idx];
+        uint64_t idle   = 0;
+        uint64_t epoch  = atomic_load( &pool->epoch );
+        if( !atomic_compare_exchange_strong( &reader->epoch, &idle, epoch ) )
+            continue;
+        
+        // the pool may have moved on before it could see
+        // the slot, in which case it has to be brought up
+        // to date or the pool might not wait for us
+        uint64_t now;
+        while( (now = atomic_load( &pool->epoch )) != epoch )
+        {
+            atomic_store( &reader->epoch, now );
+            epoch = now;
+        }
+        
+        readerHint = idx;
+        return idx;
+    }
+}
+
+void
+ck_readExit( ck_Pool* pool, unsigned ticket )
+{
+    atomic_store_explicit( &pool->readers[ticket].epoch, 0, memory_order_release );
+}
+
+int
+ck_guard( ck_Pool* pool, unsigned every )
+{
+    // region heap blocks are found from their page headers,
+    // so none of them can be off in a mapping of their own
+    if( !CK_HAVE_MMAP || (pool->config.flags & CK_REGION_HEAP) )
+        return -1;
+    if( !guardWatch( pool, every > 0 ) && every > 0 )
+        return -1;
+    
+    pool->guardEvery = every;
+    pool->guardCount = every;
+    return 0;
+}
+
+int
+ck_record( ck_Pool* pool, int fd )
+{
+    // whatever's buffered goes to the old file first
+    bool ok = true;
+    if( pool->recBuf )
+    {
+        ok = recFlush( pool );
+        pool->config.alloc( pool->config.context, pool->recBuf, 0 );
+        pool->recBuf = NULL;
+    }
+    if( fd < 0 )
+        return ok ? 0 : -1;
+    if( !CK_HAVE_MMAP )
+        return -1;
+    
+    pool->recBuf = pool->config.alloc( pool->config.context, NULL, REC_BUFFER );
+    if( pool->recBuf == NULL )
+        return -1;
+    
+    pool->recFd   = fd;
+    pool->recLast = 0;
+    memcpy( pool->recBuf, "clokrec", 8 );
+    pool->recLen  = 8;
+    return 0;
+}
+
+size_t
+ck_getRoots( ck_Pool* pool, void** allocs, size_t cap )
+{
+    size_t count = 0;
+    for( BlockSlim* iter = pool->roots ; iter ; iter = iter->eNext )
+    {
+        if( count < cap )
+            allocs[count] = slimToPtr( iter );
+        count++;
+    }
+    return count;
+}
+
+
+static inline void*
+allocRaw( ck_Pool* pool, size_t size, void* owner, uint tag )
+{
+    if( !makeRoom( pool, size, owner, tag ) )
+        return NULL;
+    
+    if( pool->used + size > pool->timerLimit )
+        armTimer( pool );
+    
+    if( pool->guardEvery && --pool->guardCount == 0 )
+    {
+        pool->guardCount = pool->guardEvery;
+        void* guarded = guardAlloc( pool, size, owner );
+        if( guarded != NULL )
+            return guarded;
+    }
+    return memAlloc( pool, size );
+}
+
+static inline bool
+makeRoom( ck_Pool* pool, size_t size, void* owner, uint tag )
+{
+    if( pool->shortfall != NULL )
+    {
+        drainFinalized( pool );
+        if( hasRoom( pool, size, tag, false ) )
+            return true;
+        noteShortfall( pool, size, tag );
+        return false;
+    }
+    
+    if( size > pool->config.quota || size > pool->tags[tag].quota )
+        return false;
+    
+    // the caller's pointer to the owner has to stay good
+    // while we make room, so compaction can't move it
+    Busy busy = { owner && owner != CK_TEMP ? ptrToFat( owner ) : NULL, pool->busy };
+    pool->busy = &busy;
+    collectFor( pool, size, tag );
+    
+    // a cycle wasn't enough, so trace the whole pool for the
+    // garbage that would have taken longer to get to
+    if( (pool->config.flags & CK_COLLECT_ALL) && !hasRoom( pool, size, tag, false ) )
+    {
+        collectAll( pool );
+        if( pool->pending > 0 )
+        {
+            ck_runFinalizers( pool, SIZE_MAX );
+            drainFinalized( pool );
+        }
+    }
+    pool->busy = busy.next;
+    
+    return hasRoom( pool, size, tag, false );
+}
+
+static inline void
+collectFor( ck_Pool* pool, size_t size, uint tag )
+{
+    drainFinalized( pool );
+    
+    // only the quotas this allocation counts against matter,
+    // so a tag that's over its own budget doesn't make
+    // anyone else's allocations collect
+    size_t ticks = NUM_SLOTS;
+    
+    // and if a whole cycle can't free enough then there's
+    // no point ticking through it to find out
+    if( forecast( pool, shortBy( pool, size, tag ) ) == UINT_MAX )
+        ticks = 0;
+    for( ;; )
+    {
+        // pending blocks will give their memory back without
+        // any more ticks, so don't count them here; empty
+        // ticks can't free anything, so they're skipped
+        while( !hasRoom( pool, size, tag, true ) && ticks > 0 )
+        {
+            ticks -= doAdvance( pool, ticks );
+            if( ticks > 0 )
+            {
+                doTick( pool );
+                ticks--;
+            }
+        }
+        
+        if( hasRoom( pool, size, tag, false ) || pool->pending == 0 )
+            break;
+        
+        // if the memory is needed right now then we can't
+        // wait for someone else to finalize the pending blocks;
+        // and if some of them are still owners they'll hold on
+        // to their memory for a bit, so we may need more ticks
+        ck_runFinalizers( pool, SIZE_MAX );
+        drainFinalized( pool );
+    }
+}
+
+static inline bool
+hasRoom( ck_Pool* pool, size_t size, uint tag, bool early )
+{
+    // with 'early' the pending blocks count as free already
+    Tag*   t     = &pool->tags[tag];
+    size_t used  = early ? pool->used - pool->pending : pool->used;
+    size_t tUsed = early ? t->used - t->pending : t->used;
+    return used + size <= pool->config.quota && tUsed + size <= t->quota;
+}
+
+static inline size_t
+shortBy( ck_Pool* pool, size_t size, uint tag )
+{
+    // bytes that have to be freed before the allocation fits,
+    // with the pending blocks counted as free already
+    Tag*   t     = &pool->tags[tag];
+    size_t used  = pool->used - pool->pending + size;
+    size_t tUsed = t->used - t->pending + size;
+    size_t over  = used > pool->config.quota ? used - pool->config.quota : 0;
+    if( tUsed > t->quota && tUsed - t->quota > over )
+        over = tUsed - t->quota;
+    return over;
+}
+
+static uint
+forecast( ck_Pool* pool, size_t bytes )
+{
+    // the totals are for everything that's due, and blocks
+    // only ever get pushed later, so this is the soonest the
+    // bytes could be freed; far cycles and old copies count
+    // from the end of the tick before their cycle starts.  the
+    // tag doesn't matter, its blocks are a part of the totals
+    size_t due = pool->pending;
+    if( due >= bytes )
+        return 0;
+    
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+    {
+        uint now = pool->clock + i;
+        if( i > 0 && now % NUM_SLOTS == 0 )
+        {
+            due += pool->eFarBytes[now / NUM_SLOTS % FAR_CYCLES];
+            due += pool->fwdBytes[FORWARD_CYCLES - 1];
+            if( due >= bytes )
+                return i;
+        }
+        
+        due += pool->eBytes[now % NUM_SLOTS];
+        if( due >= bytes )
+            return i + 1;
+    }
+    return UINT_MAX;
+}
+
+static void
+noteShortfall( ck_Pool* pool, size_t size, uint tag )
+{
+    ck_Shortfall* status = pool->shortfall;
+    Tag*          t      = &pool->tags[tag];
+    
+    // 'need' is what has to expire on top of the pending
+    // blocks, for whichever quota is still further off once
+    // its own pending blocks are counted
+    size_t over = 0;
+    size_t need = 0;
+    if( pool->used + size > pool->config.quota )
+    {
+        over = pool->used + size - pool->config.quota;
+        if( over > pool->pending )
+            need = over - pool->pending;
+    }
+    if( t->used + size > t->quota )
+    {
+        size_t tOver = t->used + size - t->quota;
+        if( tOver > over )
+            over = tOver;
+        if( tOver > t->pending && tOver - t->pending > need )
+            need = tOver - t->pending;
+    }
+    status->bytes = over;
+    
+    if( size > pool->config.quota || size > t->quota )
+    {
+        status->ticks = UINT_MAX;
+        return;
+    }
+    
+    // the forecast counts the pool's pending blocks as freed
+    // already, and its totals take in the tag's blocks along
+    // with everyone else's
+    status->ticks = forecast( pool, pool->pending + need );
+}
+
+static inline Slot
+lastSlot( ck_Pool* pool )
+{
+    // the slot furthest from now, a full cycle away
+    return (pool->clock + NUM_SLOTS - 1) % NUM_SLOTS;
+}
+
+static void
+keepStack( ck_Pool* pool )
+{
+    for( size_t i = 0 ; i < pool->depth ; i++ )
+        keepStacked( pool, pool->stack[i] );
+}
+
+static inline void
+keepStacked( ck_Pool* pool, void* alloc )
+{
+    // a block due in the current slot is pushed back a
+    // cycle, anything later can wait for its own slot
+    Slot now = pool->clock % NUM_SLOTS;
+    if( isSlab( pool, alloc ) )
+    {
+        if( *slabSlot( alloc ) == now )
+            slabMark( pool, alloc, lastSlot( pool ) );
+        return;
+    }
+    
+    BlockSlim* block = ptrToSlim( alloc );
+    if( !isRoot( block ) && !hasFlag( block, FLAG_EFAR ) && block->eSlot == now )
+    {
+        eExtract( pool, block );
+        block->eSlot = lastSlot( pool );
+        eInsert( pool, block );
+    }
+}
+
+static inline void*
+memAlloc( ck_Pool* pool, size_t size )
+{
+    if( pool->config.flags & CK_REGION_HEAP )
+        return heapAlloc( pool, size );
+    return pool->config.alloc( pool->config.context, NULL, size );
+}
+
+static inline void
+memFree( ck_Pool* pool, void* ptr )
+{
+    if( atomic_load( &pool->readersSeen ) )
+        retire( pool, ptr );
+    else
+        memRelease( pool, ptr );
+}
+
+static inline void
+memRelease( ck_Pool* pool, void* ptr )
+{
+    if( pool->guards.count > 0 )
+    {
+        Guard* guard = tableDel( &pool->guards, ptr );
+        if( guard != NULL )
+        {
+            pool->live[guard->live] = NULL;
+            guardRelease( pool, guard );
+            return;
+        }
+    }
+    
+    if( pool->config.flags & CK_REGION_HEAP )
+        heapFree( pool, ptr );
+    else
+        pool->config.alloc( pool->config.context, ptr, 0 );
+}
+
+static void
+retire( ck_Pool* pool, void* ptr )
+{
+    if( pool->nRetired == pool->capRetired )
+    {
+        size_t   cap     = pool->capRetired ? pool->capRetired * 2 : 64;
+        Retired* retired = pool->config.alloc( pool->config.context,
+                                               pool->retired,
+                                               cap * sizeof(*retired) );
+        if( retired == NULL )
+        {
+            // nowhere to keep it, so wait out the readers
+            reclaim( pool, true );
+            memRelease( pool, ptr );
+            return;
+        }
+        pool->retired    = retired;
+        pool->capRetired = cap;
+    }
+    
+    Retired* entry = &pool->retired[pool->nRetired++];
+    entry->ptr   = ptr;
+    entry->epoch = atomic_load( &pool->epoch );
+}
+
+static void
+reclaim( ck_Pool* pool, bool wait )
+{
+    // with 'wait' the epoch moves on and we spin until all
+    // readers that came in before it have left, after that
+    // everything retired so far can go
+    if( wait && pool->nRetired > 0 )
+    {
+        uint64_t epoch = atomic_fetch_add( &pool->epoch, 1 );
+        while( oldestReader( pool ) <= epoch )
+            ;
+    }
+    
+    // entries are in epoch order, so the ones that can go
+    // are all at the front
+    uint64_t oldest = oldestReader( pool );
+    size_t   count  = 0;
+    while( count < pool->nRetired && pool->retired[count].epoch < oldest )
+        memRelease( pool, pool->retired[count++].ptr );
+    
+    // 'retired' is NULL until something's been retired
+    if( count == 0 )
+        return;
+    
+    pool->nRetired -= count;
+    memmove( pool->retired,
+             pool->retired + count,
+             pool->nRetired * sizeof(*pool->retired) );
+}
+
+static uint64_t
+oldestReader( ck_Pool* pool )
+{
+    uint64_t oldest = UINT64_MAX;
+    for( uint i = 0 ; i < READER_SLOTS ; i++ )
+    {
+        uint64_t epoch = atomic_load( &pool->readers[i].epoch );
+        if( epoch != 0 && epoch < oldest )
+            oldest = epoch;
+    }
+    return oldest;
+}
+
+static inline BlockSlim*
+ptrToSlim( void* ptr )
+{
+    return ptr - sizeof(BlockSlim);
+}
+
+static inline BlockFat*
+ptrToFat( void* ptr )
+{
+    return ptr - sizeof(BlockFat);
+}
+
+static inline BlockFat*
+slimToFat( BlockSlim* slim )
+{
+    return (BlockFat*)((void*)slim - (intptr_t)&((BlockFat*)0)->slim);
+}
+
+static inline BlockSlim*
+fatToSlim( BlockFat* fat )
+{
+    return &fat->slim;
+}
+
+static inline void*
+fatToPtr( BlockFat* block )
+{
+    return (void*)block + sizeof(BlockFat);
+}
+
+static inline void*
+slimToPtr( BlockSlim* block )
+{
+    return (void*)block + sizeof(BlockSlim);
+}
+
+
+
+static inline Size
+compressSize( size_t size )
+{
+    // compressed size fits into 13 bits, the highest
+    // 5 bits are a base 2 exponent and the lower 8 are
+    // a mantissa.  sizes below 256 are stored as is,
+    // anything larger represents (256 + low8) << (high5 - 1)
+    // and is rounded up to the next representable size.
+    // sizes too big to encode give the largest encoding,
+    // so callers can detect them by decompressing
+    if( size < 256 )
+        return size;
+    
+    uint shift = 0;
+    while( (size >> shift) >= 512 )
+        shift++;
+    
+    size_t mant = (size + ((size_t)1 << shift) - 1) >> shift;
+    if( mant == 512 )
+    {
+        mant = 256;
+        shift++;
+    }
+    
+    if( shift + 1 > 0x1F )
+        return 0x1FFF;
+    
+    return (shift + 1) << 8 | (mant - 256);
+}
+
+static inline size_t
+decompressSize( Size size )
+{
+    uint high = size >> 8;
+    uint low  = size & 0xFF;
+    if( high == 0 )
+        return low;
+    return (size_t)(256 + low) << (high - 1);
+}
+
+static inline void
+setSize( BlockSlim* block, Size size )
+{
+    block->desc &= 0x7;
+    block->desc |= size << 3;
+}
+
+static inline void
+setRoot( BlockSlim* block, bool isRoot )
+{
+    if( isRoot )
+        block->desc |= 2;
+    else
+        block->desc &= ~2;
+}
+
+static inline void
+setFat( BlockSlim* block, bool isFat )
+{
+    if( isFat )
+        block->desc |= 1;
+    else
+        block->desc &= ~1;
+}
+
+static inline void
+setOrphan( BlockSlim* block, bool isOrphan )
+{
+    if( isOrphan )
+        block->desc |= 4;
+    else
+        block->desc &= ~4;
+}
+
+static inline void
+setDesc( BlockSlim* block, Size size, bool isFat, bool isRoot )
+{
+    block->desc  = 0;
+    block->flags = 0;
+    setSize( block, size );
+    setFat( block, isFat );
+    setRoot( block, isRoot );
+}
+
+static inline void
+setOwner( BlockSlim* block, BlockFat* owner )
+{
+    block->eSlot  = owner->pSlot;
+    block->eCycle = owner->pCycle;
+    setFlag( block, FLAG_EFAR, hasFlag( &owner->slim, FLAG_PFAR ) );
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat( block );
+        if( fat->owner != owner )
+        {
+            disown( fat );
+            owner->owns++;
+            fat->owner    = owner;
+            fat->cycleCD  = CK_CYCLE_DETECT_COUNTDOWN;
+            fat->level    = 0;
+        }
+    }
+}
+
+static inline void
+setFlag( BlockSlim* block, Flags flag, bool on )
+{
+    if( on )
+        block->flags |= flag;
+    else
+        block->flags &= ~flag;
+}
+
+static inline bool
+hasFlag( BlockSlim* block, Flags flag )
+{
+    return block->flags & flag;
+}
+
+static inline void
+setTag( BlockSlim* block, uint tag )
+{
+    block->flags = (block->flags & ((1 << TAG_SHIFT) - 1)) | tag << TAG_SHIFT;
+}
+
+static inline uint
+getTag( BlockSlim* block )
+{
+    return block->flags >> TAG_SHIFT;
+}
+
+static inline Size
+getSize( BlockSlim* block )
+{
+    return block->desc >> 3;
+}
+
+static inline bool
+isRoot( BlockSlim* block )
+{
+    return block->desc & 2;
+}
+
+static inline bool
+isFat( BlockSlim* block )
+{
+    return block->desc & 1;
+}
+
+static inline bool
+isOrphan( BlockSlim* block )
+{
+    return block->desc & 4;
+}
+
+static inline bool
+isMember( BlockSlim* block )
+{
+    // only fat blocks are ever orphaned, so a slim orphan
+    // is a group member's header
+    return (block->desc & 5) == 4;
+}
+
+static inline void*
+groupOf( void* ptr )
+{
+    // takes anything but a slab block
+    if( ptr == NULL || ptr == CK_TEMP )
+        return ptr;
+    BlockSlim* block = ptrToSlim( ptr );
+    if( !isMember( block ) )
+        return ptr;
+    return slimToPtr( (void*)block - (uintptr_t)block->eRef );
+}
+
+static inline void
+eInsert( ck_Pool* pool, BlockSlim* block )
+{
+    assert( !isMember( block ) );
+    BlockSlim** ePtr = &pool->eSchedule[block->eSlot];
+    if( hasFlag( block, FLAG_EFAR ) )
+        ePtr = &pool->eFar[block->eCycle % FAR_CYCLES];
+    else
+        markSlot( pool, block->eSlot );
+    block->eNext = *ePtr;
+    block->eRef  = ePtr;
+    if( block->eNext != NULL )
+        block->eNext->eRef = &block->eNext;
+    *ePtr = block;
+    *dueBytes( pool, block ) += blockBytes( block );
+}
+
+static inline void
+eExtract( ck_Pool* pool, BlockSlim* block )
+{
+    // roots are in their own list, which isn't counted
+    if( !isRoot( block ) )
+        *dueBytes( pool, block ) -= blockBytes( block );
+    *block->eRef = block->eNext;
+    if( block->eNext != NULL )
+        block->eNext->eRef = block->eRef;
+    block->eRef  = NULL;
+    block->eNext = NULL;
+}
+
+static inline size_t*
+dueBytes( ck_Pool* pool, BlockSlim* block )
+{
+    if( hasFlag( block, FLAG_EFAR ) )
+        return &pool->eFarBytes[block->eCycle % FAR_CYCLES];
+    return &pool->eBytes[block->eSlot];
+}
+
+static inline void
+pInsert( ck_Pool* pool, BlockFat* block )
+{
+    BlockFat** pPtr = &pool->pSchedule[block->pSlot];
+    if( hasFlag( &block->slim, FLAG_PFAR ) )
+        pPtr = &pool->pFar[block->pCycle % FAR_CYCLES];
+    else
+        markSlot( pool, block->pSlot );
+    block->pNext = *pPtr;
+    block->pRef  = pPtr;
+    if( block->pNext != NULL )
+        block->pNext->pRef = &block->pNext;
+    *pPtr = block;
+}
+
+static inline void
+pExtract( BlockFat* block )
+{
+    *block->pRef = block->pNext;
+    if( block->pNext != NULL )
+        block->pNext->pRef = block->pRef;
+    block->pRef  = NULL;
+    block->pNext = NULL;
+}
+
+static inline void
+doExpire( ck_Pool* pool, BlockSlim* block )
+{
+    if( !unlinkExpired( pool, block ) )
+        return;
+    
+    if( pool->config.expire )
+        pool->config.expire( pool->config.context, slimToPtr( block ) );
+    
+    freeBlock( pool, block );
+}
+
+static inline bool
+unlinkExpired( ck_Pool* pool, BlockSlim* block )
+{
+    // before it's taken from its owner and schedule
+    if( pool->guards.count > 0 )
+        guardExpire( pool, block );
+    
+    pool->expired += blockBytes( block );
+    eExtract( pool, block );
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat( block );
+        pExtract( fat );
+        
+        // when the pool is closing the owner may already be gone
+        if( !pool->closing )
+            disown( fat );
+    }
+    
+    // weak handles are cleared before the user sees the
+    // block go, so nothing can pick it up again
+    if( hasFlag( block, FLAG_WEAK ) )
+    {
+        clearWeak( pool, block );
+        setFlag( block, FLAG_WEAK, false );
+    }
+    
+    // same for the intern table, there's no flag to say
+    // if a block's in it
+    if( pool->internOf.count > 0 && !isFat( block ) )
+        forgetInterned( pool, block );
+    
+    if( pool->config.flags & CK_DEFER_FINALIZE )
+    {
+        pool->pending += blockBytes( block );
+        pool->tags[getTag( block )].pending += blockBytes( block );
+        block->eNext = NULL;
+        
+        while( atomic_flag_test_and_set_explicit( &pool->finalLock,
+                                                  memory_order_acquire ) )
+            ;
+        if( pool->finalTail != NULL )
+            pool->finalTail->eNext = block;
+        else
+            pool->finalHead = block;
+        pool->finalTail = block;
+        atomic_flag_clear_explicit( &pool->finalLock, memory_order_release );
+        return false;
+    }
+    return true;
+}
+
+static inline void
+freeBlock( ck_Pool* pool, BlockSlim* block )
+{
+    // a block that's still named as some other block's owner
+    // can't go yet since cycle detection might follow the link,
+    // so it waits for its preservation slot; by then everything
+    // it owned has either expired or been taken by a new owner
+    if( isFat( block ) && slimToFat( block )->owns > 0 && !pool->closing )
+    {
+        BlockFat*   fat  = slimToFat( block );
+        BlockSlim** tomb = &pool->tombs[fat->pSlot];
+        size_t*     due  = &pool->eBytes[fat->pSlot];
+        if( hasFlag( block, FLAG_PFAR ) )
+        {
+            tomb = &pool->tombsFar[(uchar)(fat->pCycle + 1) % FAR_CYCLES];
+            due  = &pool->eFarBytes[(uchar)(fat->pCycle + 1) % FAR_CYCLES];
+        }
+        else
+            markSlot( pool, fat->pSlot );
+        *due += blockBytes( block );
+        block->eNext = *tomb;
+        *tomb = block;
+        return;
+    }
+    
+    pool->used -= blockBytes( block );
+    pool->tags[getTag( block )].used -= blockBytes( block );
+    if( isFat( block ) )
+        memFree( pool, slimToFat(block) );
+    else
+        memFree( pool, block );
+}
+
+static inline size_t
+blockBytes( BlockSlim* block )
+{
+    size_t size = decompressSize( getSize( block ) );
+    if( isFat( block ) )
+        return size + sizeof(BlockFat);
+    return size + sizeof(BlockSlim);
+}
+
+static inline void
+drainFinalized( ck_Pool* pool )
+{
+    BlockSlim* block = atomic_exchange_explicit( &pool->finalized,
+                                                 NULL,
+                                                 memory_order_acquire );
+    while( block )
+    {
+        BlockSlim* next = block->eNext;
+        pool->pending -= blockBytes( block );
+        pool->tags[getTag( block )].pending -= blockBytes( block );
+        freeBlock( pool, block );
+        block = next;
+    }
+}
+
+static inline void
+freeTombs( ck_Pool* pool, Slot slot )
+{
+    BlockSlim* block = pool->tombs[slot];
+    pool->tombs[slot] = NULL;
+    freeDead( pool, block, &pool->eBytes[slot] );
+}
+
+static inline void
+freeDead( ck_Pool* pool, BlockSlim* block, size_t* due )
+{
+    while( block )
+    {
+        BlockSlim* next = block->eNext;
+        if( due != NULL )
+            *due -= blockBytes( block );
+        
+        // shouldn't happen, but if something still points
+        // here then find it the slow way
+        if( isFat( block ) )
+        {
+            BlockFat* fat = slimToFat( block );
+            if( fat->owns > 0 && !pool->closing )
+                disownAll( pool, fat );
+            fat->owns = 0;
+        }
+        
+        freeBlock( pool, block );
+        block = next;
+    }
+}
+
+static inline void
+endTick( ck_Pool* pool, Slot slot )
+{
+    // the sweep can put slab blocks back in the slot from
+    // an 'expire', so the bit goes first
+    pool->slotMask[slot / 64] &= ~((uint64_t)1 << slot % 64);
+    
+    // slab blocks the scan found are already out of the
+    // slot; if it came up short they all wait a cycle
+    if( pool->config.flags & CK_SLAB_SLIM )
+    {
+        if( scanOnce( pool ) )
+            slabSweep( pool, slot );
+        else
+            markSlot( pool, slot );
+    }
+    
+    freeTombs( pool, slot );
+    if( pool->eSchedule[slot] || pool->pSchedule[slot] )
+        markSlot( pool, slot );
+    pool->clock++;
+    
+    pool->expired = 0;
+    pool->scanned = false;
+    
+    if( pool->depth > 0 )
+        keepStack( pool );
+    
+    // readers that came in after this can't see anything
+    // expired before it
+    if( atomic_load_explicit( &pool->readersSeen, memory_order_relaxed ) )
+    {
+        atomic_fetch_add( &pool->epoch, 1 );
+        reclaim( pool, false );
+    }
+    
+    // retire the oldest copies and pick the pages to
+    // empty out over the coming cycle
+    if( (pool->config.flags & CK_COMPACT) && pool->clock % NUM_SLOTS == 0 )
+    {
+        freeDead( pool, pool->forwards[FORWARD_CYCLES - 1], &pool->fwdBytes[FORWARD_CYCLES - 1] );
+        for( uint i = FORWARD_CYCLES - 1 ; i > 0 ; i-- )
+        {
+            pool->forwards[i] = pool->forwards[i - 1];
+            pool->fwdBytes[i] = pool->fwdBytes[i - 1];
+        }
+        pool->forwards[0] = NULL;
+        pool->fwdBytes[0] = 0;
+        
+        heapCompact( pool );
+    }
+    
+    // TTLs can be more than a cycle out too, so this isn't
+    // just for CK_ADAPTIVE; it's quick when there's nothing
+    if( pool->clock % NUM_SLOTS == 0 )
+        flushFar( pool );
+}
+
+static void
+doTick( ck_Pool* pool )
+{
+    Slot slot = pool->clock % NUM_SLOTS;
+    
+    drainFinalized( pool );
+    drainRemote( pool );
+    
+    BlockFat** pSlot = &pool->pSchedule[slot];
+    while( *pSlot )
+        doPreserve( pool, *pSlot );
+    
+    BlockSlim** eSlot = &pool->eSchedule[slot];
+    while( *eSlot )
+    {
+        if( !keepScanned( pool, *eSlot ) )
+            doExpire( pool, *eSlot );
+    }
+    
+    endTick( pool, slot );
+}
+
+static size_t
+doAdvance( ck_Pool* pool, size_t maxTicks )
+{
+    // spans end at the cycle boundary so that whatever
+    // happens there gets its own 'endTick'
+    size_t ticks = 0;
+    while( ticks < maxTicks )
+    {
+        uint span = idleSpan( pool, pool->clock % NUM_SLOTS );
+        if( span == 0 )
+            break;
+        if( span > maxTicks - ticks )
+            span = maxTicks - ticks;
+        
+        skipTicks( pool, span );
+        ticks += span;
+    }
+    return ticks;
+}
+
+static inline void
+markSlot( ck_Pool* pool, Slot slot )
+{
+    // a slot that's just got work may be due before the
+    // timer is set to go off
+    uint64_t bit  = (uint64_t)1 << slot % 64;
+    bool     news = !(pool->slotMask[slot / 64] & bit);
+    pool->slotMask[slot / 64] |= bit;
+    if( news && pool->timerFd >= 0 )
+        timerDue( pool, slot );
+}
+
+static inline uint
+idleSpan( ck_Pool* pool, Slot slot )
+{
+    // ticks from 'slot' to the next slot that might have
+    // something in it, or to the end of the cycle
+    uint64_t bits = pool->slotMask[slot / 64] & ~(uint64_t)0 << slot % 64;
+    for( uint w = slot / 64 ; ; )
+    {
+        if( bits )
+            return w * 64 + __builtin_ctzll( bits ) - slot;
+        if( ++w == (NUM_SLOTS + 63) / 64 )
+            return NUM_SLOTS - slot;
+        bits = pool->slotMask[w];
+    }
+}
+
+static inline void
+skipTicks( ck_Pool* pool, uint ticks )
+{
+    // the slots are empty, so all that's left of their ticks
+    // is the bookkeeping; the last one gets a real 'endTick'
+    // for whatever's due at the end of the span
+    pool->expired = 0;
+    pool->clock  += ticks - 1;
+    endTick( pool, pool->clock % NUM_SLOTS );
+}
+
+static inline void
+disownAll( ck_Pool* pool, BlockFat* owner )
+{
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES && owner->owns > 0 ; i++ )
+    {
+        BlockSlim* list = i < NUM_SLOTS ? pool->eSchedule[i]
+                                        : pool->eFar[i - NUM_SLOTS];
+        for( BlockSlim* iter = list ; iter ; iter = iter->eNext )
+        {
+            if( isFat( iter ) && slimToFat( iter )->owner == owner )
+                disown( slimToFat( iter ) );
+        }
+    }
+}
+
+static inline void
+doPreserve( ck_Pool* pool, BlockFat* block )
+{
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_PRESERVE );
+        recAddr( pool, fatToPtr( block ) );
+    }
+    schedPreserve( pool, block );
+    if( pool->config.preserve )
+    {
+        Busy busy = { block, pool->busy };
+        pool->busy = &busy;
+        pool->config.preserve( pool->config.context, fatToPtr(block), pool );
+        pool->busy = busy.next;
+    }
+}
+
+static inline void
+schedPreserve( ck_Pool* pool, BlockFat* block )
+{
+    pExtract( block );
+    
+    // move the block's preservation slot to the next cycle,
+    // or further out if it's been around for a while
+    setPreserveSlot( pool, block );
+    if( (pool->config.flags & CK_ADAPTIVE) && block->level < MAX_LEVEL )
+        block->level++;
+    
+    pInsert( pool, block );
+    
+    // a block owned by an orphan is only held through the
+    // orphan's cycle as far as we know, so it's orphanized
+    // too; otherwise it would pick the cycle back up the next
+    // time it refs into it, and a cycle with more to it than
+    // its owner chain would never expire.  if something else
+    // does hold it then that ref takes it back, see 'ck_ref'
+    if( block->owner != NULL && isOrphan( fatToSlim( block->owner ) ) )
+    {
+        toOrphan( block );
+        return;
+    }
+    
+    // cycle detection, if we find a cycle then
+    // we orphanize all the blocks involved; if
+    // one of them receives a ref from outside
+    // the cycle then all will be unorphanized
+    // by an immediate preservation, otherwise
+    // they expire together, see 'orphanRef'
+    block->cycleCD--;
+    if( block->owner != NULL && block->cycleCD == 0 )
+    {
+        BlockFat* oIter = block;
+        if( inCycle( block ) )
+        {
+            do
+            {
+                BlockFat* orphan = oIter;
+                oIter = oIter->owner;
+                toOrphan( orphan );
+            } while( oIter != block );
+        }
+        
+        block->cycleCD = CK_CYCLE_DETECT_COUNTDOWN;
+    }
+}
+
+static inline bool
+inCycle( BlockFat* block )
+{
+    // the owner chain can loop back on itself without ever
+    // reaching 'block', so we leave a marker behind that's
+    // moved up at power of two distances; running into the
+    // marker means we've gone around a loop without 'block'
+    BlockFat* mark  = block->owner;
+    BlockFat* oIter = mark->owner;
+    uint      power = 1;
+    uint      steps = 1;
+    while( oIter != NULL && oIter != block && oIter != mark )
+    {
+        if( steps == power )
+        {
+            mark  = oIter;
+            power *= 2;
+            steps = 0;
+        }
+        oIter = oIter->owner;
+        steps++;
+    }
+    return oIter == block;
+}
+
+static inline void
+disown( BlockFat* block )
+{
+    if( block->owner != NULL )
+        block->owner->owns--;
+    block->owner = NULL;
+}
+
+static inline void
+toOrphan( BlockFat* block )
+{
+    // an orphan stays in the preserve schedule, what it holds
+    // still has to outlast it in case it's picked back up
+    setOrphan( fatToSlim(block), true );
+    disown( block );
+}
+
+static inline void
+orphanRef( ck_Pool* pool, BlockFat* owner, BlockSlim* block )
+{
+    // an orphan's refs keep a block around for as long as the
+    // orphan itself and no longer, and don't take ownership or
+    // unorphanize anything; so its cycle can't keep itself
+    // alive, and nothing it holds expires before it does
+    BlockSlim* oSlim = fatToSlim( owner );
+    uint       until = dueIn( pool, oSlim->eSlot, oSlim->eCycle, hasFlag( oSlim, FLAG_EFAR ) );
+    uint       was   = dueIn( pool, block->eSlot, block->eCycle, hasFlag( block, FLAG_EFAR ) );
+    if( was >= until )
+        return;
+    
+    eExtract( pool, block );
+    scheduleIn( pool, block, until );
+    
+    // the orphans it holds were only kept until it was due, so
+    // it has to preserve by then to pass the extension along
+    if( !isFat( block ) || !isOrphan( block ) )
+        return;
+    BlockFat* fat = slimToFat( block );
+    if( dueIn( pool, fat->pSlot, fat->pCycle, hasFlag( block, FLAG_PFAR ) ) > was )
+    {
+        uint at = pool->clock + was;
+        pExtract( fat );
+        fat->pSlot  = at % NUM_SLOTS;
+        fat->pCycle = at / NUM_SLOTS;
+        setFlag( block, FLAG_PFAR, was >= NUM_SLOTS );
+        pInsert( pool, fat );
+    }
+}
+
+static inline void
+toRoot( ck_Pool* pool, BlockSlim* block )
+{
+    setRoot( block, true );
+    setFlag( block, FLAG_EFAR, false );
+    block->eCycle = 0;
+    block->eNext = pool->roots;
+    block->eRef  = &pool->roots;
+    if( block->eNext != NULL )
+        block->eNext->eRef = &block->eNext;
+    pool->roots = block;
+    
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat(block);
+        disown( fat );
+    }
+}
+
+static inline bool
+shouldRef( ck_Pool* pool, BlockFat* owner, BlockSlim* block )
+{
+    if( isOrphan( block ) )
+        return true;
+    if( hasFlag( block, FLAG_EFAR ) || hasFlag( &owner->slim, FLAG_PFAR ) )
+        return dueIn( pool, block->eSlot, block->eCycle, hasFlag( block, FLAG_EFAR ) ) <
+               dueIn( pool, owner->pSlot, owner->pCycle, hasFlag( &owner->slim, FLAG_PFAR ) );
+    if( isBefore( pool, block->eSlot, owner->pSlot ) )
+        return true;
+    return false;
+}
+
+static inline void
+setPreserveSlot( ck_Pool* pool, BlockFat* block )
+{
+    // preserve slot is set to a random slot after
+    // the expiration slot; since we have a limited
+    // number of slots, the 'after' means that the
+    // slot is in the range between the block's
+    // expiration time and the current clock, starting
+    // at the expiration and overflowing at the max.
+    // This actually results in some clustering of expiration
+    // events as the distance between the current clock
+    // and expiration increase, but the alternative is
+    // complete randomization which results in objects
+    // living for much longer than necessary sice the propegation
+    // of a dropped reference could take up to NUM_SLOTS^CHAIN_LEN
+    // ticks; where CHAIN_LEN is the number of references from
+    // the initial drop to the end of the chain
+    
+    // with CK_ADAPTIVE the same goes for stable blocks, but
+    // the window stretches out to 2^level cycles; a block
+    // that expires in a far cycle can't preserve any sooner
+    BlockSlim* slim = fatToSlim( block );
+    if( (pool->config.flags & CK_ADAPTIVE) &&
+        (block->level > 0 || hasFlag( slim, FLAG_EFAR )) )
+    {
+        uint       expire  = isRoot( slim ) ? 1 : dueIn( pool,
+                                                         slim->eSlot,
+                                                         slim->eCycle,
+                                                         hasFlag( slim, FLAG_EFAR ) );
+        uint       horizon = (NUM_SLOTS << block->level) - 2;
+        uint       due     = expire;
+        if( horizon > expire )
+            due += RAND_NUMS[pool->rand++ % RAND_COUNT] % (horizon - expire);
+        
+        uint at = pool->clock + due;
+        block->pSlot  = at % NUM_SLOTS;
+        block->pCycle = at / NUM_SLOTS;
+        setFlag( slim, FLAG_PFAR, due >= NUM_SLOTS );
+        return;
+    }
+    setFlag( slim, FLAG_PFAR, false );
+    
+    Slot now = pool->clock % NUM_SLOTS;
+    Slot rnd = RAND_NUMS[pool->rand++ % RAND_COUNT] % NUM_SLOTS;
+    Slot max = now - 2;
+    Slot min;
+    if( isRoot( slim ) )
+        min = now + 1;
+    else
+        min = block->slim.eSlot;
+    
+    if( min == max )
+        block->pSlot = min;
+    else
+    if( max > min )
+        block->pSlot = (min + rnd % (max-min)) % NUM_SLOTS;
+    else
+        block->pSlot = (min + rnd % (NUM_SLOTS-min+max)) % NUM_SLOTS;
+}
+
+static inline uint
+dueIn( ck_Pool* pool, Slot slot, uchar cycle, bool far )
+{
+    // ticks until the slot comes up; for far blocks that's
+    // in their own cycle, which is always a later one
+    uint now = pool->clock % NUM_SLOTS;
+    if( !far )
+        return (slot + NUM_SLOTS - now) % NUM_SLOTS;
+    
+    uchar cycles = cycle - (uchar)(pool->clock / NUM_SLOTS);
+    return cycles * NUM_SLOTS + slot - now;
+}
+
+static void
+flushFar( ck_Pool* pool )
+{
+    // the new cycle's blocks go into the schedules by slot,
+    // and the tombs from the last one have outlived their kids
+    uint idx = pool->clock / NUM_SLOTS % FAR_CYCLES;
+    while( pool->eFar[idx] )
+    {
+        BlockSlim* block = pool->eFar[idx];
+        eExtract( pool, block );
+        setFlag( block, FLAG_EFAR, false );
+        eInsert( pool, block );
+    }
+    while( pool->pFar[idx] )
+    {
+        BlockFat* block = pool->pFar[idx];
+        pExtract( block );
+        setFlag( &block->slim, FLAG_PFAR, false );
+        pInsert( pool, block );
+    }
+    
+    BlockSlim* tombs = pool->tombsFar[idx];
+    pool->tombsFar[idx] = NULL;
+    freeDead( pool, tombs, &pool->eFarBytes[idx] );
+}
+
+static inline bool
+isBefore( ck_Pool* pool, Slot before, Slot after )
+{
+    Slot slot = pool->clock % NUM_SLOTS;
+    if( slot < after && before >= slot && before < after )
+        return true;
+    if( slot > after && before < after )
+        return true;
+    if( slot > after && before >= slot )
+        return true;
+    
+    return false;
+}
+
+static inline bool
+canMove( ck_Pool* pool, BlockSlim* block )
+{
+    // roots may be held from outside the pool, so they
+    // have to stay put
+    if( isRoot( block ) )
+        return false;
+    
+    // a full collection's marked blocks are in a list of
+    // their own, and it's put back before anything moves
+    if( pool->marking )
+        return false;
+    
+    // with a far cycle on either side its owner or kids might
+    // not get back to it before the forwarder is gone
+    if( hasFlag( block, FLAG_EFAR | FLAG_PFAR ) )
+        return false;
+    
+    void* base = isFat( block ) ? (void*)slimToFat( block ) : (void*)block;
+    if( !ptrToPage( base )->evac )
+        return false;
+    
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat( block );
+        if( fat == pool->eventBlock )
+            return false;
+        for( Busy* iter = pool->busy ; iter ; iter = iter->next )
+        {
+            if( iter->block == fat )
+                return false;
+        }
+    }
+    
+    // the root stack holds addresses for native code
+    for( size_t i = 0 ; i < pool->depth ; i++ )
+    {
+        if( pool->stack[i] == slimToPtr( block ) )
+            return false;
+    }
+    return true;
+}
+
+static BlockSlim*
+moveBlock( ck_Pool* pool, BlockSlim* block )
+{
+    // the old copy is only freed a cycle from now, so
+    // the move has to fit in the quota with it
+    size_t bytes = blockBytes( block );
+    if( !hasRoom( pool, bytes, getTag( block ), false ) )
+        return block;
+    
+    void* from = isFat( block ) ? (void*)slimToFat( block ) : (void*)block;
+    void* to   = heapAlloc( pool, bytes );
+    if( to == NULL )
+        return block;
+    
+    memcpy( to, from, bytes );
+    BlockSlim* moved = isFat( block ) ? fatToSlim( to ) : to;
+    
+    if( hasFlag( block, FLAG_WEAK ) )
+    {
+        ck_Weak* weak = tableGet( &pool->weakTable, block );
+        if( !tablePut( pool, &pool->weakTable, moved, weak ) )
+        {
+            heapFree( pool, to );
+            return block;
+        }
+        tableDel( &pool->weakTable, block );
+        setFlag( block, FLAG_WEAK, false );
+        for( ; weak ; weak = weak->chain )
+            weak->alloc = slimToPtr( moved );
+    }
+    
+    void* hash = pool->internOf.count > 0 ? tableGet( &pool->internOf, block ) : NULL;
+    if( hash != NULL )
+    {
+        void* size = tableGet( &pool->internSize, block );
+        if( !tablePut( pool, &pool->internOf, moved, hash ) ||
+            !tablePut( pool, &pool->internSize, moved, size ) )
+        {
+            tableDel( &pool->internOf, moved );
+            heapFree( pool, to );
+            return block;
+        }
+        tableDel( &pool->internOf, block );
+        tableDel( &pool->internSize, block );
+        tablePut( pool, &pool->interns, hash, slimToPtr( moved ) );
+    }
+    
+    // the copy takes the old block's place in the schedules
+    *moved->eRef = moved;
+    if( moved->eNext != NULL )
+        moved->eNext->eRef = &moved->eNext;
+    
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat( moved );
+        *fat->pRef = fat;
+        if( fat->pNext != NULL )
+            fat->pNext->pRef = &fat->pNext;
+        
+        // the copy inherits the old block's link to its owner,
+        // but whatever the old block owned still points at it
+        // until 'ck_refMove' passes them over
+        fat->owns = 0;
+        slimToFat( block )->owner = NULL;
+    }
+    
+    // anyone that hasn't preserved since the move still has
+    // the old address, so it forwards to the copy for a while
+    setFlag( block, FLAG_MOVED, true );
+    block->eRef  = (BlockSlim**)moved;
+    block->eNext = pool->forwards[0];
+    pool->forwards[0] = block;
+    pool->fwdBytes[0] += bytes;
+    
+    pool->used += bytes;
+    pool->tags[getTag( block )].used += bytes;
+    return moved;
+}
+
+static inline BlockSlim*
+resolveMoved( BlockSlim* block )
+{
+    while( hasFlag( block, FLAG_MOVED ) )
+        block = (BlockSlim*)block->eRef;
+    return block;
+}
+
+
+
+// region heap
+static void*
+heapAlloc( ck_Pool* pool, size_t size )
+{
+#if CK_HAVE_MMAP
+    Heap* heap  = &pool->heap;
+    uint  klass = sizeClass( size );
+    
+    if( klass == LARGE_CLASS )
+    {
+        // big blocks get their own mapping, aligned like
+        // the pages so the header can still be found
+        size_t span = (PAGE_HEAD + size + 4095) & ~(size_t)4095;
+        Page*  page = mapAligned( span, REGION_PAGE );
+        if( page == NULL )
+            return NULL;
+        
+        if( (pool->config.flags & CK_SCAN_STACKS) && !mapPages( pool, page, span, page ) )
+        {
+            munmap( page, span );
+            return NULL;
+        }
+        
+        page->chunk = NULL;
+        page->span  = span;
+        page->klass = LARGE_CLASS;
+        page->count = 1;
+        page->next  = heap->large;
+        page->ref   = &heap->large;
+        if( page->next != NULL )
+            page->next->ref = &page->next;
+        heap->large = page;
+        
+        heap->resident += span;
+        return (void*)page + PAGE_HEAD;
+    }
+    
+    return classAlloc( pool, klass, false );
+#else
+    return NULL;
+#endif
+}
+
+static void*
+classAlloc( ck_Pool* pool, uint klass, bool slab )
+{
+#if CK_HAVE_MMAP
+    Heap* heap = &pool->heap;
+    
+    // take the first page from the densest bucket
+    Page* page = NULL;
+    for( int d = NUM_DENSITIES - 1 ; d >= 0 && !page ; d-- )
+        page = heap->partial[slab][klass][d];
+    
+    if( page == NULL )
+    {
+        page = pageAcquire( pool, klass, slab );
+        if( page == NULL )
+            return NULL;
+    }
+    
+    uint idx = 0;
+    for( uint w = 0 ; w < PAGE_WORDS ; w++ )
+    {
+        if( ~page->bits[w] )
+        {
+            idx = w * 64 + __builtin_ctzll( ~page->bits[w] );
+            break;
+        }
+    }
+    
+    page->bits[idx / 64] |= (uint64_t)1 << idx % 64;
+    page->count++;
+    pageLink( heap, page );
+    
+    return (void*)page + page->base + idx * CLASS_SIZES[klass];
+#else
+    return NULL;
+#endif
+}
+
+static void
+heapFree( ck_Pool* pool, void* ptr )
+{
+#if CK_HAVE_MMAP
+    Heap* heap = &pool->heap;
+    Page* page = ptrToPage( ptr );
+    
+    if( page->klass == LARGE_CLASS )
+    {
+        pageUnlink( page );
+        heap->resident -= page->span;
+        if( pool->config.flags & CK_SCAN_STACKS )
+            mapPages( pool, page, page->span, NULL );
+        munmap( page, page->span );
+        return;
+    }
+    
+    uint idx = (ptr - (void*)page - page->base) / CLASS_SIZES[page->klass];
+    assert( page->bits[idx / 64] & (uint64_t)1 << idx % 64 );
+    page->bits[idx / 64] &= ~((uint64_t)1 << idx % 64);
+    page->count--;
+    
+    if( page->count == 0 )
+        pageRelease( pool, page );
+    else
+        pageLink( heap, page );
+#endif
+}
+
+static void
+heapClear( ck_Pool* pool )
+{
+#if CK_HAVE_MMAP
+    // large mappings are all gone by now since every
+    // block has been freed, so only the chunks are left
+    Chunk* chunk = pool->heap.chunks;
+    while( chunk )
+    {
+        Chunk* next = chunk->next;
+        munmap( chunk->base, REGION_CHUNK );
+        pool->config.alloc( pool->config.context, chunk, 0 );
+        chunk = next;
+    }
+    memset( &pool->heap, 0, sizeof(pool->heap) );
+#endif
+}
+
+static void
+heapCompact( ck_Pool* pool )
+{
+    Heap* heap = &pool->heap;
+    
+    // whatever's still in last cycle's pages was pinned
+    // or never ref'd through 'ck_refMove', so they go
+    // back to the buckets and get another look
+    while( heap->evacuating )
+    {
+        Page* page = heap->evacuating;
+        pageUnlink( page );
+        page->evac = false;
+        pageLink( heap, page );
+    }
+    
+    // sparse pages are only emptied if the rest of the
+    // class has room for their blocks, otherwise they'd
+    // just be moved into fresh pages that are as sparse
+    for( uint klass = 0 ; klass < NUM_CLASSES ; klass++ )
+    {
+        size_t room = 0;
+        for( uint d = 0 ; d < NUM_DENSITIES ; d++ )
+        {
+            for( Page* iter = heap->partial[0][klass][d] ; iter ; iter = iter->next )
+                room += iter->cap - iter->count;
+        }
+        
+        Page* page = heap->partial[0][klass][0];
+        while( page )
+        {
+            Page*  next  = page->next;
+            size_t other = room - (page->cap - page->count);
+            if( page->count <= other )
+            {
+                room = other - page->count;
+                pageUnlink( page );
+                page->evac = true;
+                page->next = heap->evacuating;
+                page->ref  = &heap->evacuating;
+                if( page->next != NULL )
+                    page->next->ref = &page->next;
+                heap->evacuating = page;
+            }
+            page = next;
+        }
+    }
+}
+
+static inline uint
+sizeClass( size_t size )
+{
+    if( size > CLASS_SIZES[NUM_CLASSES-1] )
+        return LARGE_CLASS;
+    
+    uint klass = 0;
+    while( CLASS_SIZES[klass] < size )
+        klass++;
+    return klass;
+}
+
+static inline Page*
+ptrToPage( void* ptr )
+{
+    return (Page*)((uintptr_t)ptr & ~(uintptr_t)(REGION_PAGE - 1));
+}
+
+static inline void
+pageLink( Heap* heap, Page* page )
+{
+    // moves the page into the bucket matching its
+    // density; full pages aren't in any bucket, and
+    // neither are the ones being evacuated
+    if( page->evac )
+        return;
+    
+    if( page->count == page->cap )
+    {
+        if( page->ref )
+            pageUnlink( page );
+        return;
+    }
+    
+    uchar density = page->count * NUM_DENSITIES / page->cap;
+    if( page->ref && page->density == density )
+        return;
+    if( page->ref )
+        pageUnlink( page );
+    
+    Page** pPtr = &heap->partial[page->slab][page->klass][density];
+    page->density = density;
+    page->next    = *pPtr;
+    page->ref     = pPtr;
+    if( page->next != NULL )
+        page->next->ref = &page->next;
+    *pPtr = page;
+}
+
+static inline void
+pageUnlink( Page* page )
+{
+    *page->ref = page->next;
+    if( page->next != NULL )
+        page->next->ref = page->ref;
+    page->ref  = NULL;
+    page->next = NULL;
+}
+
+static Page*
+pageAcquire( ck_Pool* pool, uint klass, bool slab )
+{
+#if CK_HAVE_MMAP
+    Heap* heap = &pool->heap;
+    
+    // prefer the fullest chunk that still has room,
+    // leaving the emptier ones a chance to drain
+    Chunk* chunk = NULL;
+    for( Chunk* iter = heap->chunks ; iter ; iter = iter->next )
+    {
+        if( iter->nFree && (!chunk || iter->nFree < chunk->nFree) )
+            chunk = iter;
+    }
+    
+    if( chunk == NULL )
+    {
+        chunk = pool->config.alloc( pool->config.context,
+                                    NULL,
+                                    sizeof(*chunk) );
+        if( chunk == NULL )
+            return NULL;
+        
+        chunk->base = mapAligned( REGION_CHUNK, REGION_CHUNK );
+        if( chunk->base == NULL )
+        {
+            pool->config.alloc( pool->config.context, chunk, 0 );
+            return NULL;
+        }
+        
+#ifdef MADV_HUGEPAGE
+        if( pool->config.flags & CK_HUGE_PAGES )
+            madvise( chunk->base, REGION_CHUNK, MADV_HUGEPAGE );
+#endif
+        
+        memset( chunk->free, 0xFF, sizeof(chunk->free) );
+        chunk->nFree = CHUNK_PAGES;
+        chunk->next  = heap->chunks;
+        heap->chunks = chunk;
+    }
+    
+    uint idx = 0;
+    for( uint w = 0 ; w < CHUNK_PAGES / 64 ; w++ )
+    {
+        if( chunk->free[w] )
+        {
+            idx = w * 64 + __builtin_ctzll( chunk->free[w] );
+            break;
+        }
+    }
+    chunk->free[idx / 64] &= ~((uint64_t)1 << idx % 64);
+    chunk->nFree--;
+    
+    // released pages read back as zero, but with huge
+    // pages they're recycled without being released
+    Page* page = chunk->base + idx * REGION_PAGE;
+    memset( page, 0, sizeof(*page) );
+    page->chunk = chunk;
+    page->klass = klass;
+    page->cap   = (REGION_PAGE - PAGE_HEAD) / CLASS_SIZES[klass];
+    page->base  = PAGE_HEAD;
+    
+    // slab pages give up some blocks for the slot bytes,
+    // which stay a multiple of the stride so the blocks
+    // keep their alignment
+    if( slab )
+    {
+        uint size = CLASS_SIZES[klass];
+        page->slab  = true;
+        page->cap   = (REGION_PAGE - PAGE_HEAD - SLOT_STRIDE) / (size + 1);
+        page->base  = PAGE_HEAD + (page->cap + SLOT_STRIDE - 1) / SLOT_STRIDE * SLOT_STRIDE;
+        page->recip = UINT32_MAX / size + 1;
+        memset( (void*)page + PAGE_HEAD, SLOT_NONE, page->base - PAGE_HEAD );
+        
+        page->slabNext = heap->slabs;
+        page->slabRef  = &heap->slabs;
+        if( page->slabNext != NULL )
+            page->slabNext->slabRef = &page->slabNext;
+        heap->slabs = page;
+    }
+    
+    // mark the bits past the page's capacity as taken
+    // so the allocation search never hands them out
+    for( uint i = page->cap ; i < PAGE_WORDS * 64 ; i++ )
+        page->bits[i / 64] |= (uint64_t)1 << i % 64;
+    
+    heap->resident += REGION_PAGE;
+    if( (pool->config.flags & CK_SCAN_STACKS) && !mapPages( pool, page, REGION_PAGE, page ) )
+    {
+        pageRelease( pool, page );
+        return NULL;
+    }
+    return page;
+#else
+    return NULL;
+#endif
+}
+
+static void
+pageRelease( ck_Pool* pool, Page* page )
+{
+#if CK_HAVE_MMAP
+    Heap*  heap  = &pool->heap;
+    Chunk* chunk = page->chunk;
+    uint   idx   = ((void*)page - chunk->base) / REGION_PAGE;
+    
+    if( page->ref )
+        pageUnlink( page );
+    
+    if( page->slab )
+    {
+        *page->slabRef = page->slabNext;
+        if( page->slabNext != NULL )
+            page->slabNext->slabRef = page->slabRef;
+    }
+    
+    chunk->free[idx / 64] |= (uint64_t)1 << idx % 64;
+    chunk->nFree++;
+    heap->resident -= REGION_PAGE;
+    if( pool->config.flags & CK_SCAN_STACKS )
+        mapPages( pool, page, REGION_PAGE, NULL );
+    
+#if CK_LAZY_RELEASE && defined(MADV_FREE)
+    int advice = MADV_FREE;
+#else
+    int advice = MADV_DONTNEED;
+#endif
+    
+    if( !(pool->config.flags & CK_HUGE_PAGES) )
+        madvise( page, REGION_PAGE, advice );
+    else
+    if( chunk->nFree == CHUNK_PAGES )
+        madvise( chunk->base, REGION_CHUNK, advice );
+#endif
+}
+
+static void*
+mapAligned( size_t size, size_t align )
+{
+#if CK_HAVE_MMAP
+    // over-map by the alignment and trim the excess
+    // off of both ends
+    size_t span = size + align;
+    void*  map  = mmap( NULL, span,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0 );
+    if( map == MAP_FAILED )
+        return NULL;
+    
+    uintptr_t base = ((uintptr_t)map + align - 1) & ~(uintptr_t)(align - 1);
+    size_t    head = base - (uintptr_t)map;
+    if( head )
+        munmap( map, head );
+    if( span - head - size )
+        munmap( (void*)(base + size), span - head - size );
+    
+    return (void*)base;
+#else
+    return NULL;
+#endif
+}
+
+static bool
+mapPages( ck_Pool* pool, void* base, size_t span, Page* page )
+{
+    // puts the pages of a mapping in the page map, or
+    // takes them out if 'page' is NULL
+    for( void* at = base ; at < base + span ; at += REGION_PAGE )
+    {
+        if( page == NULL )
+            tableDel( &pool->pageMap, at );
+        else
+        if( !tablePut( pool, &pool->pageMap, at, page ) )
+        {
+            mapPages( pool, base, at - base, NULL );
+            return false;
+        }
+    }
+    
+    if( page != NULL && (uintptr_t)base < pool->mapLo )
+        pool->mapLo = (uintptr_t)base;
+    if( page != NULL && (uintptr_t)base + span > pool->mapHi )
+        pool->mapHi = (uintptr_t)base + span;
+    return true;
+}
+
+
+
+// slabs
+static inline bool
+isSlab( ck_Pool* pool, void* ptr )
+{
+    // a block's header is always on the same page as the
+    // byte before its data, a slab block's slot bytes or a
+    // neighbor are too; so this works for either kind
+    return (pool->config.flags & CK_SLAB_SLIM) && ptrToPage( ptr - 1 )->slab;
+}
+
+static inline uchar*
+slabSlot( void* ptr )
+{
+    Page* page = ptrToPage( ptr - 1 );
+    uint  idx  = (uint64_t)(ptr - (void*)page - page->base) * page->recip >> 32;
+    return (uchar*)page + PAGE_HEAD + idx;
+}
+
+static void*
+slabAlloc( ck_Pool* pool, size_t size, void* owner )
+{
+    uint   klass = sizeClass( size );
+    size_t bytes = CLASS_SIZES[klass];
+    if( !makeRoom( pool, bytes, owner, 0 ) )
+        return NULL;
+    
+    void* alloc = classAlloc( pool, klass, true );
+    if( alloc == NULL )
+        return NULL;
+    
+    slabMark( pool, alloc, owner == CK_TEMP ? lastSlot( pool ) : ptrToFat( owner )->pSlot );
+    pool->used += bytes;
+    pool->tags[0].used += bytes;
+    return alloc;
+}
+
+static inline void
+slabRef( ck_Pool* pool, void* alloc, void* owner )
+{
+    // the whole ref is a compare and a store, slab
+    // blocks aren't in any list
+    uchar* slot = slabSlot( alloc );
+    if( *slot == SLOT_NONE )
+        return;
+    
+    if( owner == NULL )
+    {
+        pool->eBytes[*slot] -= CLASS_SIZES[ptrToPage( alloc - 1 )->klass];
+        *slot = SLOT_NONE;
+        return;
+    }
+    
+    Slot pSlot = ptrToFat( owner )->pSlot;
+    if( isBefore( pool, *slot, pSlot ) )
+        slabMark( pool, alloc, pSlot );
+}
+
+static inline void
+slabMark( ck_Pool* pool, void* alloc, Slot slot )
+{
+    Page*  page = ptrToPage( alloc - 1 );
+    uchar* old  = slabSlot( alloc );
+    if( *old != SLOT_NONE )
+        pool->eBytes[*old] -= CLASS_SIZES[page->klass];
+    pool->eBytes[slot] += CLASS_SIZES[page->klass];
+    *old = slot;
+    page->slotMask[slot / 64] |= (uint64_t)1 << slot % 64;
+    markSlot( pool, slot );
+}
+
+static void
+slabSweep( ck_Pool* pool, Slot slot )
+{
+    uint64_t bit  = (uint64_t)1 << slot % 64;
+    Page*    page = pool->heap.slabs;
+    while( page )
+    {
+        Page* next = page->slabNext;
+        if( !(page->slotMask[slot / 64] & bit) )
+        {
+            page = next;
+            continue;
+        }
+        
+        // nothing in the page will have this slot once we're
+        // done, unless it's ref'd again from an 'expire'
+        page->slotMask[slot / 64] &= ~bit;
+        
+        uchar* slots = (uchar*)page + PAGE_HEAD;
+        bool   empty = false;
+        for( uint i = 0 ; i < page->cap && !empty ; i += SLOT_STRIDE )
+        {
+            uint match = slotMatch( slots + i, slot );
+            while( match && !empty )
+            {
+                uint idx = i + __builtin_ctz( match );
+                match &= match - 1;
+                
+                // the last block takes the page with it
+                empty = page->count == 1;
+                slabExpire( pool, page, idx );
+            }
+        }
+        page = next;
+    }
+}
+
+static inline uint
+slotMatch( uchar const* slots, Slot slot )
+{
+    // bit i is set if slots[i] == slot
+#if defined(__AVX2__)
+    __m256i bytes = _mm256_loadu_si256( (__m256i const*)slots );
+    __m256i want  = _mm256_set1_epi8( (char)slot );
+    return (uint)_mm256_movemask_epi8( _mm256_cmpeq_epi8( bytes, want ) );
+#elif defined(__SSE2__)
+    __m128i want = _mm_set1_epi8( (char)slot );
+    __m128i lo   = _mm_loadu_si128( (__m128i const*)slots );
+    __m128i hi   = _mm_loadu_si128( (__m128i const*)(slots + 16) );
+    return (uint)_mm_movemask_epi8( _mm_cmpeq_epi8( lo, want ) ) |
+           (uint)_mm_movemask_epi8( _mm_cmpeq_epi8( hi, want ) ) << 16;
+#else
+    uint match = 0;
+    for( uint i = 0 ; i < SLOT_STRIDE ; i++ )
+        match |= (uint)(slots[i] == slot) << i;
+    return match;
+#endif
+}
+
+static void
+slabExpire( ck_Pool* pool, Page* page, uint idx )
+{
+    void* alloc = (void*)page + page->base + idx * CLASS_SIZES[page->klass];
+    
+    if( pool->weakTable.count > 0 )
+        clearWeak( pool, ptrToSlim( alloc ) );
+    if( pool->internOf.count > 0 )
+        forgetInterned( pool, ptrToSlim( alloc ) );
+    
+    if( pool->config.expire )
+        pool->config.expire( pool->config.context, alloc );
+    
+    uchar* slot = (uchar*)page + PAGE_HEAD + idx;
+    if( *slot != SLOT_NONE )
+        pool->eBytes[*slot] -= CLASS_SIZES[page->klass];
+    *slot = SLOT_NONE;
+    pool->expired += CLASS_SIZES[page->klass];
+    pool->used -= CLASS_SIZES[page->klass];
+    pool->tags[0].used -= CLASS_SIZES[page->klass];
+    memFree( pool, alloc );
+}
+
+static void
+slabExpireAll( ck_Pool* pool )
+{
+    // pages leave the list as their last block goes
+    while( pool->heap.slabs )
+    {
+        Page* page = pool->heap.slabs;
+        for( uint idx = 0 ; idx < page->cap ; idx++ )
+        {
+            if( page->bits[idx / 64] & (uint64_t)1 << idx % 64 )
+            {
+                bool last = page->count == 1;
+                slabExpire( pool, page, idx );
+                if( last )
+                    break;
+            }
+        }
+    }
+}
+
+
+
+// stack scanning
+static inline bool
+scanOnce( ck_Pool* pool )
+{
+    // the stacks are scanned the first time a tick needs
+    // them, returns false if the scan came up short
+    if( !(pool->config.flags & CK_SCAN_STACKS) )
+        return true;
+    if( !pool->scanned )
+    {
+        scanStacks( pool );
+        pool->scanned = true;
+    }
+    return !pool->scanLost;
+}
+
+static void
+scanStacks( ck_Pool* pool )
+{
+    // callee saved registers might hold the only copy of a
+    // pointer, setjmp spills them into this frame
+    jmp_buf regs;
+    setjmp( regs );
+    void const* sp = &regs;
+    
+    if( pool->scanHits.count > 0 )
+    {
+        memset( pool->scanHits.entries, 0, pool->scanHits.cap * sizeof(Entry) );
+        pool->scanHits.count = 0;
+    }
+    pool->scanLost = pool->mapLost;
+    
+    for( size_t i = 0 ; i < pool->nScans ; i++ )
+    {
+        void const* lo = pool->scans[i].lo;
+        void const* hi = pool->scans[i].hi;
+        if( lo == NULL || (sp >= lo && sp < hi) )
+            lo = sp;
+        if( lo < hi )
+            scanRange( pool, lo, hi );
+    }
+}
+
+static NO_ASAN void
+scanRange( ck_Pool* pool, void const* lo, void const* hi )
+{
+    uintptr_t const* at = (void*)(((uintptr_t)lo + sizeof(uintptr_t) - 1) &
+                                  ~(uintptr_t)(sizeof(uintptr_t) - 1));
+    for( ; (void const*)(at + 1) <= hi ; at++ )
+    {
+        // most words aren't anywhere near the heap
+        uintptr_t word = *at;
+        if( word < pool->mapLo || word >= pool->mapHi )
+            continue;
+        
+        Page* page = tableGet( &pool->pageMap, (void*)(word & ~(uintptr_t)(REGION_PAGE - 1)) );
+        if( page == NULL )
+            continue;
+        
+        // anything in a block's slot counts, header and all
+        void* base = (void*)page + PAGE_HEAD;
+        if( page->klass != LARGE_CLASS )
+        {
+            if( word < (uintptr_t)page + page->base )
+                continue;
+            
+            uint size = CLASS_SIZES[page->klass];
+            uint idx  = (word - (uintptr_t)page - page->base) / size;
+            if( idx >= page->cap || !(page->bits[idx / 64] & (uint64_t)1 << idx % 64) )
+                continue;
+            
+            // slab blocks can be moved out of the slot now,
+            // before the sweep gets to them
+            base = (void*)page + page->base + idx * size;
+            if( page->slab )
+            {
+                if( pool->marking )
+                    markRef( pool, base );
+                else
+                    keepStacked( pool, base );
+                continue;
+            }
+        }
+        else
+        if( word < (uintptr_t)base )
+            continue;
+        
+        if( !tablePut( pool, &pool->scanHits, base, base ) )
+            pool->scanLost = true;
+    }
+}
+
+static inline bool
+keepScanned( ck_Pool* pool, BlockSlim* block )
+{
+    // a block found by the scan is pushed back a cycle
+    // instead of expiring, like the root stack's
+    if( !(pool->config.flags & CK_SCAN_STACKS) )
+        return false;
+    
+    scanOnce( pool );
+    void* base = isFat( block ) ? (void*)slimToFat( block ) : (void*)block;
+    if( !pool->scanLost && !tableGet( &pool->scanHits, base ) )
+        return false;
+    
+    eExtract( pool, block );
+    block->eSlot = lastSlot( pool );
+    eInsert( pool, block );
+    return true;
+}
+
+
+
+// remote refs
+static inline void
+pushRemote( _Atomic(Remote*)* list, Remote* entry )
+{
+    Remote* head = atomic_load_explicit( list, memory_order_relaxed );
+    do
+    {
+        entry->next = head;
+    } while( !atomic_compare_exchange_weak_explicit( list,
+                                                     &head,
+                                                     entry,
+                                                     memory_order_release,
+                                                     memory_order_relaxed ) );
+}
+
+static void
+drainRemote( ck_Pool* pool )
+{
+    if( atomic_load_explicit( &pool->inbox, memory_order_relaxed ) == NULL )
+        return;
+    
+    Remote* entry = atomic_exchange_explicit( &pool->inbox,
+                                              NULL,
+                                              memory_order_acquire );
+    while( entry )
+    {
+        Remote* next = entry->next;
+        applyRemote( pool, entry->alloc, entry->ticks );
+        pushRemote( &entry->home->spent, entry );
+        entry = next;
+    }
+}
+
+static void
+applyRemote( ck_Pool* pool, void* alloc, uint ticks )
+{
+    // the owner's clock may be a little behind ours, so the
+    // block gets a few ticks more than it asked for
+    keepFor( pool, alloc, ticks + REMOTE_SLACK );
+}
+
+static void
+keepFor( ck_Pool* pool, void* alloc, uint ticks )
+{
+    // pushes the block's expiration out to at least 'ticks'
+    // from now, slab blocks can't go past the cycle
+    if( isSlab( pool, alloc ) )
+    {
+        uchar* slot = slabSlot( alloc );
+        Slot   at   = (pool->clock + (ticks < NUM_SLOTS ? ticks : NUM_SLOTS - 1)) % NUM_SLOTS;
+        if( *slot != SLOT_NONE && isBefore( pool, *slot, at ) )
+            slabMark( pool, alloc, at );
+        return;
+    }
+    
+    BlockSlim* block = resolveMoved( ptrToSlim( groupOf( alloc ) ) );
+    if( isRoot( block ) )
+        return;
+    
+    if( dueIn( pool, block->eSlot, block->eCycle, hasFlag( block, FLAG_EFAR ) ) < ticks )
+    {
+        eExtract( pool, block );
+        scheduleIn( pool, block, ticks );
+    }
+    
+    // something outside of the orphan's cycle holds it now,
+    // so it has to take its kids back; see 'ck_ref'
+    if( isFat( block ) && isOrphan( block ) )
+    {
+        setOrphan( block, false );
+        doPreserve( pool, slimToFat( block ) );
+    }
+}
+
+static inline void
+scheduleIn( ck_Pool* pool, BlockSlim* block, uint ticks )
 {
-    uint ticks = NUM_SLOTS;
-    while( pool->used + amount > pool->config.quota && ticks-- )
-        ck_tick( pool );
+    // past the end of the cycle it waits in a far list,
+    // the caller's taken it out of its old one
+    uint at = pool->clock + ticks;
+    block->eSlot  = at % NUM_SLOTS;
+    block->eCycle = at / NUM_SLOTS;
+    setFlag( block, FLAG_EFAR, ticks >= NUM_SLOTS );
+    eInsert( pool, block );
 }
 
-size_t
-ck_avail( ck_Pool* pool )
+
+
+// time driven ticks
+static inline uint
+ttlTicks( ck_Pool* pool, uint64_t ttl )
 {
-    return pool->config.quota - pool->used;
+    // rounded up, a tick only ends once all of its time has
+    // passed; and short of the far lists wrapping around.  the
+    // clock may not have caught up with the time yet, so the
+    // ticks it's behind by count too
+    uint64_t ticks = ttl / pool->tickTime + (ttl % pool->tickTime != 0);
+    uint     lag   = timeTarget( pool ) - pool->clock;
+    if( (int)lag > 0 )
+        ticks += lag;
+    if( ticks > (FAR_CYCLES - 1) * NUM_SLOTS )
+        ticks = (FAR_CYCLES - 1) * NUM_SLOTS;
+    return ticks;
 }
 
-size_t
-ck_used( ck_Pool* pool )
+static uint64_t
+monotonicNow( void* context )
 {
-    return pool->used;
+    (void)context;
+#if defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
 }
 
+static inline uint
+timeTarget( ck_Pool* pool )
+{
+    // the clock the time says it should be at
+    if( pool->timeNow == NULL )
+        return pool->clock;
+    
+    uint64_t elapsed = pool->timeNow( pool->config.context ) - pool->timeBase;
+    return pool->clockBase + (uint)(elapsed / pool->tickTime);
+}
 
-static inline void*
-allocRaw( ck_Pool* pool, size_t size )
+
+
+// idle collection
+static inline uint
+idleAhead( ck_Pool* pool )
 {
-    if( size > pool->config.quota )
-        return NULL;
+    // ticks it'd take to get back above the mark, as long
+    // as a cycle can do it at all
+    size_t mark  = pool->config.quota / IDLE_HEADROOM;
+    size_t avail = ck_avail( pool );
+    if( pool->used > pool->config.quota )
+        avail = 0;
+    if( avail + pool->pending >= mark )
+        return 0;
     
-    uint ticks = NUM_SLOTS;
-    while( pool->used + size > pool->config.quota && ticks-- )
+    uint ticks = forecast( pool, mark - avail );
+    return ticks == UINT_MAX ? 0 : ticks;
+}
+
+static void
+idleStep( ck_Pool* pool, uint until )
+{
+    // a block at a time like ck_step(), except the clock
+    // mustn't skip past 'until'
+    Slot slot = pool->clock % NUM_SLOTS;
+    if( pool->pSchedule[slot] || pool->eSchedule[slot] )
+        ck_step( pool );
+    else
+    if( ck_advance( pool, until - pool->clock ) == 0 )
         ck_tick( pool );
+}
+
+static void
+armTimer( ck_Pool* pool )
+{
+#if CK_HAVE_TIMERFD
+    if( pool->timerFd < 0 )
+        return;
     
-    if( pool->used + size > pool->config.quota )
-        return NULL;
+    // an allocation that takes the pool under the mark
+    // re-arms it, unless it's already under and nothing
+    // due can help
+    size_t   mark  = pool->config.quota / IDLE_HEADROOM;
+    uint64_t delay = 0;
+    pool->timerHot   = false;
+    pool->timerTick  = pool->clock + NUM_SLOTS * FAR_CYCLES;
+    pool->timerLimit = SIZE_MAX;
+    if( ck_avail( pool ) + pool->pending >= mark && pool->used <= pool->config.quota )
+        pool->timerLimit = pool->config.quota - mark + pool->pending;
     
-    return pool->config.alloc( pool->config.context, NULL, size );
+    // a zero delay would disarm it, so work that's due
+    // already gets the shortest one instead
+    if( idleAhead( pool ) > 0 || (int)(timeTarget( pool ) - pool->clock) > 0 )
+    {
+        pool->timerHot   = true;
+        pool->timerLimit = SIZE_MAX;
+        delay = 1;
+    }
+    else
+    if( pool->timeNow )
+    {
+        // the next slot that might have work is due once
+        // the time reaches the tick after it
+        uint     due = pool->clock + idleSpan( pool, pool->clock % NUM_SLOTS );
+        uint64_t at  = pool->timeBase + (uint64_t)(uint)(due + 1 - pool->clockBase) * pool->tickTime;
+        uint64_t now = pool->timeNow( pool->config.context );
+        delay = at > now ? at - now : 1;
+        pool->timerTick = due;
+    }
+    
+    struct itimerspec spec;
+    memset( &spec, 0, sizeof(spec) );
+    spec.it_value.tv_sec  = delay / 1000000000;
+    spec.it_value.tv_nsec = delay % 1000000000;
+    timerfd_settime( pool->timerFd, 0, &spec, NULL );
+#endif
 }
 
-static inline BlockSlim*
-ptrToSlim( void* ptr )
+static void
+timerDue( ck_Pool* pool, Slot slot )
 {
-    return ptr - sizeof(BlockSlim);
+    // only a time source makes a slot due at a given time
+    if( pool->timeNow == NULL || pool->timerHot )
+        return;
+    
+    uint due = pool->clock + (slot + NUM_SLOTS - pool->clock % NUM_SLOTS) % NUM_SLOTS;
+    if( (int)(due - pool->timerTick) < 0 )
+        armTimer( pool );
 }
 
-static inline BlockFat*
-ptrToFat( void* ptr )
+
+
+// frozen sets
+static inline bool
+isFrozen( BlockSlim* block )
 {
-    return ptr - sizeof(BlockFat);
+    return isRoot( block ) && block->eCycle == FROZEN_CYCLE;
 }
 
-static inline BlockFat*
-slimToFat( BlockSlim* slim )
+static void
+freezeRef( ck_Pool* pool, void* alloc, BlockFat* owner, bool walk )
 {
-    return (BlockFat*)((void*)slim - (intptr_t)&((BlockFat*)0)->slim);
+    // roots are left as they are, and so are blocks that are
+    // frozen already, even in another set
+    Frozen* frozen = &pool->frozen[owner->slim.eSlot];
+    if( isSlab( pool, alloc ) )
+    {
+        if( *slabSlot( alloc ) == SLOT_NONE )
+            return;
+        
+        // without room in the list it's rooted for good,
+        // which beats letting it expire while it's held
+        if( frozen->nSlabs == frozen->capSlabs )
+        {
+            size_t cap   = frozen->capSlabs ? frozen->capSlabs * 2 : 64;
+            void** slabs = pool->config.alloc( pool->config.context,
+                                               frozen->slabs,
+                                               cap * sizeof(*slabs) );
+            if( slabs != NULL )
+            {
+                frozen->slabs    = slabs;
+                frozen->capSlabs = cap;
+            }
+        }
+        if( frozen->nSlabs < frozen->capSlabs )
+            frozen->slabs[frozen->nSlabs++] = alloc;
+        slabRef( pool, alloc, NULL );
+        return;
+    }
+    
+    BlockSlim* block = ptrToSlim( groupOf( alloc ) );
+    if( isRoot( block ) )
+        return;
+    
+    eExtract( pool, block );
+    freezeBlock( pool, block, frozen );
+    
+    // a walk that's already going will get to it, and a new
+    // block has nothing to walk
+    if( isFat( block ) && walk && pool->freezing != frozen )
+        freezeWalk( pool, frozen, slimToFat( block ) );
 }
 
-static inline BlockSlim*
-fatToSlim( BlockFat* fat )
+static void
+freezeBlock( ck_Pool* pool, BlockSlim* block, Frozen* frozen )
 {
-    return &fat->slim;
+    // it's out of its schedule already, the root bit keeps
+    // refs from putting it back in
+    assert( !isMember( block ) );
+    setRoot( block, true );
+    setFlag( block, FLAG_EFAR, false );
+    block->eSlot  = frozen - pool->frozen;
+    block->eCycle = FROZEN_CYCLE;
+    block->eNext  = frozen->blocks;
+    block->eRef   = &frozen->blocks;
+    if( block->eNext != NULL )
+        block->eNext->eRef = &block->eNext;
+    frozen->blocks = block;
+    
+    if( isFat( block ) )
+    {
+        BlockFat* fat = slimToFat( block );
+        pExtract( fat );
+        disown( fat );
+        setOrphan( block, false );
+        fat->level = 0;
+        fat->pRef  = frozen->fatTail;
+        *frozen->fatTail = fat;
+        frozen->fatTail  = &fat->pNext;
+    }
 }
 
-static inline void*
-fatToPtr( BlockFat* block )
+static void
+freezeWalk( ck_Pool* pool, Frozen* frozen, BlockFat* from )
 {
-    return (void*)block + sizeof(BlockFat);
+    // each block is preserved once more, but its refs freeze
+    // what they ref instead; those go on the end of the list
+    // so this gets to them too
+    Frozen* outer = pool->freezing;
+    pool->freezing = frozen;
+    for( BlockFat* fat = from ; fat ; fat = fat->pNext )
+    {
+        if( pool->recBuf )
+        {
+            recOp( pool, CK_OP_PRESERVE );
+            recAddr( pool, fatToPtr( fat ) );
+        }
+        if( pool->config.preserve )
+        {
+            Busy busy = { fat, pool->busy };
+            pool->busy = &busy;
+            pool->config.preserve( pool->config.context, fatToPtr( fat ), pool );
+            pool->busy = busy.next;
+        }
+    }
+    pool->freezing = outer;
 }
 
-static inline void*
-slimToPtr( BlockSlim* block )
+static inline void
+giveCycle( ck_Pool* pool, BlockSlim* block )
 {
-    return (void*)block + sizeof(BlockSlim);
+    // refs made while the block was a root were ignored, so
+    // other blocks may be holding it without the schedule
+    // knowing; give it a full cycle, every live holder will
+    // have been preserved and re-ref'd it by then, and the
+    // first one to do so will become its owner
+    block->eSlot = (pool->clock + NUM_SLOTS - 1) % NUM_SLOTS;
+    
+    // with CK_ADAPTIVE a holder can go as long as the longest
+    // period before it gets back to the block
+    if( pool->config.flags & CK_ADAPTIVE )
+    {
+        uint at = pool->clock + (NUM_SLOTS << MAX_LEVEL) - 1;
+        block->eSlot  = at % NUM_SLOTS;
+        block->eCycle = at / NUM_SLOTS;
+        setFlag( block, FLAG_EFAR, true );
+    }
+    eInsert( pool, block );
 }
 
 
 
-static inline Size
-compressSize( size_t size )
+// full collection
+static size_t
+collectAll( ck_Pool* pool )
 {
-    // compressed size fits into 13 bytes,
-    // the highest 5 bits represent a base
-    // 2 exponent and the lower 8 represent
-    // an byte offset; so the actual size
-    // represented is (1 << high5 + low8)
-    uint low  = size & 0xFF;
-    uint high = 0;
+    // the preserve callback is how a block's refs are found,
+    // and a collection can't start from inside one of its own
+    if( pool->config.preserve == NULL || pool->marking )
+        return 0;
+    
+    drainFinalized( pool );
+    drainRemote( pool );
+    size_t before = pool->expired;
     
-    size >>= 8;
-    while( size )
+    // every slab block could be marked, so there's room for
+    // all of them up front
+    size_t slabs = 0;
+    for( Page* page = pool->heap.slabs ; page ; page = page->slabNext )
+        slabs += page->count;
+    if( slabs > 0 )
     {
-        high++;
-        high >>= 1;
+        pool->slabMarks = pool->config.alloc( pool->config.context,
+                                              NULL,
+                                              slabs * sizeof(Entry) );
+        if( pool->slabMarks != NULL )
+            pool->capSlabMarks = slabs;
     }
     
-    // if (high == 0) then we can take one byte
-    // away from (low) since we know that one
-    // byte is implied
-    if( high == 0 && low != 0 )
-        low--;
+    if( markAll( pool ) )
+    {
+        sweepAll( pool );
+        if( !pool->markLost )
+            sweepSlabs( pool );
+    }
+    unmarkAll( pool );
     
-    return high << 8 | low;
+    if( pool->slabMarks != NULL )
+        pool->config.alloc( pool->config.context, pool->slabMarks, 0 );
+    pool->slabMarks    = NULL;
+    pool->nSlabMarks   = 0;
+    pool->capSlabMarks = 0;
+    pool->markLost     = false;
+    return pool->expired - before;
 }
 
-static inline size_t
-decompressSize( Size size )
+static bool
+markAll( ck_Pool* pool )
 {
-    return (1 << (size & 0x1FF << 8)) + (size & 0xFF);
+    // refs made while marking just mark; it stays on through
+    // the sweep, so an 'expire' that refs a block keeps it
+    pool->marking  = true;
+    pool->marked   = NULL;
+    pool->markTail = &pool->marked;
+    
+    // the blocks that are held without being ref'd
+    for( size_t i = 0 ; i < pool->depth ; i++ )
+        markRef( pool, pool->stack[i] );
+    for( Busy* iter = pool->busy ; iter ; iter = iter->next )
+    {
+        if( iter->block != NULL )
+            markBlock( pool, fatToSlim( iter->block ) );
+    }
+    if( pool->eventBlock != NULL )
+        markBlock( pool, fatToSlim( pool->eventBlock ) );
+    
+    // a fresh scan, it marks the slab blocks it finds itself;
+    // if it comes up short then anything could be held, so
+    // there's nothing to sweep
+    bool exact = true;
+    if( pool->config.flags & CK_SCAN_STACKS )
+    {
+        pool->scanned = false;
+        exact = scanOnce( pool );
+        for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES && exact ; i++ )
+        {
+            BlockSlim* block = i < NUM_SLOTS ? pool->eSchedule[i]
+                                             : pool->eFar[i - NUM_SLOTS];
+            while( block )
+            {
+                BlockSlim* next = block->eNext;
+                void*      base = isFat( block ) ? (void*)slimToFat( block ) : (void*)block;
+                if( tableGet( &pool->scanHits, base ) )
+                    markBlock( pool, block );
+                block = next;
+            }
+        }
+    }
+    
+    // frozen sets are closed, so they're left out; everything
+    // else reachable is preserved once, the marked blocks go
+    // on the end of the list as it's walked
+    for( BlockSlim* root = pool->roots ; root ; root = root->eNext )
+    {
+        if( isFat( root ) )
+            doMark( pool, slimToFat( root ) );
+    }
+    for( BlockSlim* block = pool->marked ; block ; block = block->eNext )
+    {
+        if( isFat( block ) )
+            doMark( pool, slimToFat( block ) );
+    }
+    return exact;
 }
 
 static inline void
-setSize( BlockSlim* block, Size size )
+doMark( ck_Pool* pool, BlockFat* block )
 {
-    block->desc &= 0x7;
-    block->desc |= size << 3;
+    // the refs it makes are marks, see 'ck_ref'
+    if( pool->recBuf )
+    {
+        recOp( pool, CK_OP_PRESERVE );
+        recAddr( pool, fatToPtr( block ) );
+    }
+    Busy busy = { block, pool->busy };
+    pool->busy = &busy;
+    pool->config.preserve( pool->config.context, fatToPtr( block ), pool );
+    pool->busy = busy.next;
 }
 
-static inline void
-setRoot( BlockSlim* block, bool isRoot )
+static void
+markRef( ck_Pool* pool, void* alloc )
 {
-    if( isRoot )
-        block->desc |= 2;
-    else
-        block->desc &= ~2;
+    // a slab block's slot is kept so it can be put back,
+    // without room for that it just stays where it is
+    if( isSlab( pool, alloc ) )
+    {
+        uchar* slot = slabSlot( alloc );
+        if( *slot == SLOT_NONE )
+            return;
+        if( pool->nSlabMarks == pool->capSlabMarks )
+        {
+            pool->markLost = true;
+            return;
+        }
+        pool->slabMarks[pool->nSlabMarks++] = (Entry){ alloc, (void*)(uintptr_t)*slot };
+        slabRef( pool, alloc, NULL );
+        return;
+    }
+    
+    markBlock( pool, resolveMoved( ptrToSlim( groupOf( alloc ) ) ) );
 }
 
 static inline void
-setFat( BlockSlim* block, bool isFat )
+markBlock( ck_Pool* pool, BlockSlim* block )
 {
-    if( isFat )
-        block->desc |= 1;
+    // blocks without an 'eRef' have expired already
+    assert( !isMember( block ) );
+    if( isMarked( pool, block ) || block->eRef == NULL )
+        return;
+    
+    eExtract( pool, block );
+    block->eRef     = &pool->marked;
+    *pool->markTail = block;
+    pool->markTail  = &block->eNext;
+}
+
+static inline bool
+isMarked( ck_Pool* pool, BlockSlim* block )
+{
+    // roots and frozen blocks are always live
+    return isRoot( block ) || block->eRef == &pool->marked;
+}
+
+static void
+sweepAll( ck_Pool* pool )
+{
+    // everything left in the schedules is garbage; none of
+    // it can stay an owner, or it'd have to wait as a tomb,
+    // so it's all disowned first.  that goes for the marked
+    // blocks' owners that aren't live, tombs included
+    for( BlockSlim* block = pool->marked ; block ; block = block->eNext )
+    {
+        if( !isFat( block ) )
+            continue;
+        BlockFat* fat = slimToFat( block );
+        if( fat->owner != NULL && !isMarked( pool, &fat->owner->slim ) )
+            disown( fat );
+    }
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES ; i++ )
+    {
+        BlockSlim* list = i < NUM_SLOTS ? pool->eSchedule[i]
+                                        : pool->eFar[i - NUM_SLOTS];
+        for( BlockSlim* iter = list ; iter ; iter = iter->eNext )
+        {
+            if( isFat( iter ) )
+                disown( slimToFat( iter ) );
+        }
+    }
+    
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES ; i++ )
+    {
+        BlockSlim** list = i < NUM_SLOTS ? &pool->eSchedule[i]
+                                         : &pool->eFar[i - NUM_SLOTS];
+        while( *list )
+            doExpire( pool, *list );
+    }
+    
+    // and now nothing names the tombs
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+        freeTombs( pool, i );
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+    {
+        BlockSlim* tombs = pool->tombsFar[i];
+        pool->tombsFar[i] = NULL;
+        freeDead( pool, tombs, &pool->eFarBytes[i] );
+    }
+}
+
+static void
+sweepSlabs( ck_Pool* pool )
+{
+    // the marked slab blocks are out of their slots, so any
+    // that are still in one are garbage
+    Page* page = pool->heap.slabs;
+    while( page )
+    {
+        Page*  next  = page->slabNext;
+        uchar* slots = (uchar*)page + PAGE_HEAD;
+        for( uint idx = 0 ; idx < page->cap ; idx++ )
+        {
+            if( slots[idx] == SLOT_NONE )
+                continue;
+            
+            // the last block takes the page with it
+            bool last = page->count == 1;
+            slabExpire( pool, page, idx );
+            if( last )
+                break;
+        }
+        page = next;
+    }
+}
+
+static void
+unmarkAll( ck_Pool* pool )
+{
+    // marked blocks go back where they were, no time has
+    // passed so their slots are still ahead
+    for( size_t i = 0 ; i < pool->nSlabMarks ; i++ )
+        slabMark( pool, pool->slabMarks[i].key, (Slot)(uintptr_t)pool->slabMarks[i].val );
+    while( pool->marked )
+    {
+        BlockSlim* block = pool->marked;
+        pool->marked = block->eNext;
+        eInsert( pool, block );
+    }
+    pool->markTail = &pool->marked;
+    pool->marking  = false;
+}
+
+
+
+// guard pages
+
+// pools with sampling on, for the fault handler, and the
+// handlers it took over from; the lock is only for changing
+// the chain, the handler just walks it
+static ck_Pool*    guardPools;
+static atomic_flag guardLock = ATOMIC_FLAG_INIT;
+static bool        guardHooked;
+#if CK_HAVE_MMAP
+static struct sigaction guardPrev[2];
+#endif
+
+static void*
+guardAlloc( ck_Pool* pool, size_t size, void* owner )
+{
+#if CK_HAVE_MMAP
+    uint live = 0;
+    while( live < GUARD_LIVE && pool->live[live] != NULL )
+        live++;
+    if( live == GUARD_LIVE )
+        return NULL;
+    
+    // the block ends where the guard page starts, so an
+    // overrun faults too
+    size_t page = sysconf( _SC_PAGESIZE );
+    size_t span = (size + page - 1) / page * page + page;
+    void*  base = mmap( NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( base == MAP_FAILED )
+        return NULL;
+    
+    Guard* guard = pool->config.alloc( pool->config.context, NULL, sizeof(Guard) );
+    void*  block = base + span - page - ((size + 15) & ~(size_t)15);
+    if( guard == NULL || mprotect( base + span - page, page, PROT_NONE ) ||
+        !tablePut( pool, &pool->guards, block, guard ) )
+    {
+        pool->config.alloc( pool->config.context, guard, 0 );
+        munmap( base, span );
+        return NULL;
+    }
+    
+    memset( guard, 0, sizeof(*guard) );
+    guard->base  = base;
+    guard->span  = span;
+    guard->block = block;
+    guard->size  = size;
+    guard->owner = owner == CK_TEMP ? NULL : owner;
+    guard->live  = live;
+    pool->live[live] = guard;
+    return block;
+#else
+    return NULL;
+#endif
+}
+
+static void
+guardExpire( ck_Pool* pool, BlockSlim* block )
+{
+    // a fat block's owner is the one that should have kept
+    // it, a slim block only has the one it started with
+    void*  base  = isFat( block ) ? (void*)slimToFat( block ) : (void*)block;
+    Guard* guard = tableGet( &pool->guards, base );
+    if( guard == NULL )
+        return;
+    
+    guard->alloc   = slimToPtr( block );
+    guard->clock   = pool->clock;
+    guard->eSlot   = block->eSlot;
+    guard->fat     = isFat( block );
+    guard->expired = true;
+    if( guard->fat && slimToFat( block )->owner != NULL )
+        guard->owner = fatToPtr( slimToFat( block )->owner );
+}
+
+static void
+guardRelease( ck_Pool* pool, Guard* guard )
+{
+#if CK_HAVE_MMAP
+    if( pool->closing )
+    {
+        munmap( guard->base, guard->span );
+        pool->config.alloc( pool->config.context, guard, 0 );
+        return;
+    }
+    
+    mprotect( guard->base, guard->span, PROT_NONE );
+    
+    Guard** slot = &pool->quarantine[pool->nextQuarantine];
+    pool->nextQuarantine = (pool->nextQuarantine + 1) % GUARD_QUARANTINE;
+    if( *slot != NULL )
+    {
+        munmap( (*slot)->base, (*slot)->span );
+        pool->config.alloc( pool->config.context, *slot, 0 );
+    }
+    *slot = guard;
+#endif
+}
+
+static bool
+guardWatch( ck_Pool* pool, bool on )
+{
+#if CK_HAVE_MMAP
+    while( atomic_flag_test_and_set_explicit( &guardLock, memory_order_acquire ) )
+        ;
+    
+    ck_Pool** link = &guardPools;
+    while( *link != NULL && *link != pool )
+        link = &(*link)->guardNext;
+    if( on && *link == NULL )
+    {
+        pool->guardNext = guardPools;
+        guardPools      = pool;
+    }
     else
-        block->desc &= ~1;
+    if( !on && *link != NULL )
+    {
+        *link = pool->guardNext;
+        pool->guardNext = NULL;
+    }
+    
+    bool ok = true;
+    if( on && !guardHooked )
+    {
+        struct sigaction action;
+        memset( &action, 0, sizeof(action) );
+        action.sa_sigaction = guardFault;
+        action.sa_flags     = SA_SIGINFO;
+        sigemptyset( &action.sa_mask );
+        ok = !sigaction( SIGSEGV, &action, &guardPrev[0] ) &&
+             !sigaction( SIGBUS, &action, &guardPrev[1] );
+        guardHooked = ok;
+    }
+    
+    atomic_flag_clear_explicit( &guardLock, memory_order_release );
+    return ok;
+#else
+    return false;
+#endif
+}
+
+static Guard*
+guardFind( Guard* guard, void* addr )
+{
+    if( guard == NULL || addr < guard->base || addr >= guard->base + guard->span )
+        return NULL;
+    return guard;
+}
+
+#if CK_HAVE_MMAP
+static void
+guardFault( int sig, siginfo_t* info, void* context )
+{
+    Guard* guard = NULL;
+    for( ck_Pool* pool = guardPools ; pool && !guard ; pool = pool->guardNext )
+    {
+        for( uint i = 0 ; i < GUARD_QUARANTINE && !guard ; i++ )
+            guard = guardFind( pool->quarantine[i], info->si_addr );
+        for( uint i = 0 ; i < GUARD_LIVE && !guard ; i++ )
+            guard = guardFind( pool->live[i], info->si_addr );
+    }
+    
+    // printf isn't safe in a signal handler, so the report's
+    // put together by hand
+    if( guard != NULL )
+    {
+        char   report[256];
+        size_t len = 0;
+        reportStr( report, &len, "clok: access at 0x" );
+        reportNum( report, &len, (uintptr_t)info->si_addr, 16 );
+        if( guard->expired )
+        {
+            reportStr( report, &len, guard->fat ? " to expired fat block 0x"
+                                                : " to expired slim block 0x" );
+            reportNum( report, &len, (uintptr_t)guard->alloc, 16 );
+            reportStr( report, &len, " (" );
+            reportNum( report, &len, guard->size, 10 );
+            reportStr( report, &len, " bytes); it expired in tick " );
+            reportNum( report, &len, guard->clock, 10 );
+            reportStr( report, &len, ", slot " );
+            reportNum( report, &len, guard->eSlot, 10 );
+            reportStr( report, &len, ", last owner 0x" );
+        }
+        else
+        {
+            reportStr( report, &len, " past the end of block 0x" );
+            reportNum( report, &len, (uintptr_t)guard->block, 16 );
+            reportStr( report, &len, " (" );
+            reportNum( report, &len, guard->size, 10 );
+            reportStr( report, &len, " bytes), allocated for owner 0x" );
+        }
+        reportNum( report, &len, (uintptr_t)guard->owner, 16 );
+        reportStr( report, &len, "\n" );
+        if( write( STDERR_FILENO, report, len ) < 0 )
+            len = 0;
+    }
+    
+    // the faulting access runs again once we return, with
+    // whatever handled it before; that's the default crash
+    // for our own faults
+    struct sigaction* prev = &guardPrev[sig == SIGBUS];
+    if( guard == NULL && (prev->sa_flags & SA_SIGINFO) )
+    {
+        prev->sa_sigaction( sig, info, context );
+        return;
+    }
+    if( guard == NULL && prev->sa_handler != SIG_DFL && prev->sa_handler != SIG_IGN )
+    {
+        prev->sa_handler( sig );
+        return;
+    }
+    signal( sig, SIG_DFL );
+}
+
+static void
+reportStr( char* buf, size_t* len, char const* str )
+{
+    // the report buffer is 256 bytes, anything past that's cut
+    while( *str && *len < 255 )
+        buf[(*len)++] = *str++;
+}
+
+static void
+reportNum( char* buf, size_t* len, uint64_t num, uint base )
+{
+    char  digits[24];
+    char* at = digits + sizeof(digits);
+    *--at = 0;
+    do
+    {
+        *--at = "0123456789abcdef"[num % base];
+        num /= base;
+    } while( num > 0 );
+    reportStr( buf, len, at );
+}
+#endif
+
+
+
+// side tables
+static inline size_t
+tableHash( void* key, size_t cap )
+{
+    uint64_t h = (uintptr_t)key >> 3;
+    h *= 0x9E3779B97F4A7C15ull;
+    return (h >> 32) & (cap - 1);
 }
 
-static inline void
-setOrphan( BlockSlim* block, bool isOrphan )
+static void*
+tableGet( Table* table, void* key )
 {
-    if( isOrphan )
-        block->desc |= 4;
-    else
-        block->desc &= ~4;
+    if( table->count == 0 )
+        return NULL;
+    
+    size_t i = tableHash( key, table->cap );
+    while( table->entries[i].key != NULL )
+    {
+        if( table->entries[i].key == key )
+            return table->entries[i].val;
+        i = (i + 1) & (table->cap - 1);
+    }
+    return NULL;
 }
 
-static inline void
-setDesc( BlockSlim* block, Size size, bool isFat, bool isRoot )
+static bool
+tablePut( ck_Pool* pool, Table* table, void* key, void* val )
 {
-    block->desc = 0;
-    setSize( block, size );
-    setFat( block, isFat );
-    setRoot( block, isRoot );
+    // grow at 3/4 load, rehashing into a table twice the size
+    if( (table->count + 1) * 4 > table->cap * 3 )
+    {
+        size_t cap     = table->cap ? table->cap * 2 : 64;
+        Entry* entries = pool->config.alloc( pool->config.context,
+                                             NULL,
+                                             cap * sizeof(Entry) );
+        if( entries == NULL )
+            return false;
+        memset( entries, 0, cap * sizeof(Entry) );
+        
+        for( size_t i = 0 ; i < table->cap ; i++ )
+        {
+            if( table->entries[i].key == NULL )
+                continue;
+            size_t j = tableHash( table->entries[i].key, cap );
+            while( entries[j].key != NULL )
+                j = (j + 1) & (cap - 1);
+            entries[j] = table->entries[i];
+        }
+        
+        if( table->entries )
+            pool->config.alloc( pool->config.context, table->entries, 0 );
+        table->entries = entries;
+        table->cap     = cap;
+    }
+    
+    size_t i = tableHash( key, table->cap );
+    while( table->entries[i].key != NULL && table->entries[i].key != key )
+        i = (i + 1) & (table->cap - 1);
+    
+    if( table->entries[i].key == NULL )
+        table->count++;
+    table->entries[i].key = key;
+    table->entries[i].val = val;
+    return true;
 }
 
-static inline void
-setOwner( BlockSlim* block, BlockFat* owner )
+static void*
+tableDel( Table* table, void* key )
 {
-    block->eSlot = owner->pSlot;
-    if( isFat( block ) )
+    if( table->count == 0 )
+        return NULL;
+    
+    size_t i = tableHash( key, table->cap );
+    while( table->entries[i].key != key )
     {
-        BlockFat* fat = slimToFat( block );
-        if( fat->owner != owner )
+        if( table->entries[i].key == NULL )
+            return NULL;
+        i = (i + 1) & (table->cap - 1);
+    }
+    
+    void* val = table->entries[i].val;
+    table->count--;
+    
+    // shift back any following entries that would
+    // otherwise become unreachable through the hole
+    size_t j = i;
+    for( ;; )
+    {
+        table->entries[i].key = NULL;
+        for( ;; )
         {
-            fat->owner    = owner;
-            fat->cycleCD  = CK_CYCLE_DETECT_COUNTDOWN;
+            j = (j + 1) & (table->cap - 1);
+            if( table->entries[j].key == NULL )
+                return val;
+            
+            size_t k = tableHash( table->entries[j].key, table->cap );
+            if( i <= j ? (i < k && k <= j) : (i < k || k <= j) )
+                continue;
+            break;
         }
+        table->entries[i] = table->entries[j];
+        i = j;
     }
 }
 
-static inline Size
-getSize( BlockSlim* block )
+static void
+tableFree( ck_Pool* pool, Table* table )
 {
-    return block->desc >> 3;
+    if( table->entries )
+        pool->config.alloc( pool->config.context, table->entries, 0 );
+    memset( table, 0, sizeof(*table) );
 }
 
-static inline bool
-isRoot( BlockSlim* block )
+static void
+clearWeak( ck_Pool* pool, BlockSlim* block )
 {
-    return block->desc & 2;
+    ck_Weak* weak = tableDel( &pool->weakTable, block );
+    while( weak )
+    {
+        ck_Weak* chain = weak->chain;
+        weak->alloc = NULL;
+        weak->chain = NULL;
+        weak = chain;
+    }
 }
 
-static inline bool
-isFat( BlockSlim* block )
+static inline uint64_t
+hashBytes( void const* data, size_t size )
 {
-    return block->desc & 1;
+    // a word at a time, then folded; the size goes in too
+    // so a blob and its zero padded copy differ.  never zero
+    // since it's used as a table key
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    uchar const* at = data;
+    for( ; size >= 8 ; at += 8, size -= 8 )
+    {
+        uint64_t word;
+        memcpy( &word, at, 8 );
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+    if( size > 0 )
+    {
+        uint64_t word = 0;
+        memcpy( &word, at, size );
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+    }
+    hash ^= hash >> 29;
+    return hash | 1;
 }
 
-static inline bool
-isOrphan( BlockSlim* block )
+static void
+forgetInterned( ck_Pool* pool, BlockSlim* block )
 {
-    return block->desc & 4;
+    void* hash = tableDel( &pool->internOf, block );
+    tableDel( &pool->internSize, block );
+    if( hash != NULL && tableGet( &pool->interns, hash ) == slimToPtr( block ) )
+        tableDel( &pool->interns, hash );
 }
 
 static inline void
-eInsert( ck_Pool* pool, BlockSlim* block )
+tempRef( ck_Pool* pool, void* alloc )
 {
-    BlockSlim** ePtr = &pool->eSchedule[block->eSlot];
-    block->eNext = *ePtr;
-    block->eRef  = ePtr;
-    if( block->eNext != NULL )
-        block->eNext->eRef = &block->eNext;
-    *ePtr = block;
+    // gives an existing block what allocating it with
+    // CK_TEMP would have, the rest of a cycle; never any
+    // less than it already had
+    Slot last = lastSlot( pool );
+    if( isSlab( pool, alloc ) )
+    {
+        uchar* slot = slabSlot( alloc );
+        if( *slot != SLOT_NONE && isBefore( pool, *slot, last ) )
+            slabMark( pool, alloc, last );
+        return;
+    }
+    
+    BlockSlim* block = ptrToSlim( alloc );
+    if( isRoot( block ) || hasFlag( block, FLAG_EFAR ) )
+        return;
+    if( !isBefore( pool, block->eSlot, last ) )
+        return;
+    eExtract( pool, block );
+    block->eSlot = last;
+    eInsert( pool, block );
 }
 
-static inline void
-eExtract( BlockSlim* block )
+
+
+// pool images
+static void
+imageLayout( uint* layout )
 {
-    *block->eRef = block->eNext;
-    if( block->eNext != NULL )
-        block->eNext->eRef = block->eRef;
-    block->eRef  = NULL;
-    block->eNext = NULL;
+    layout[0] = sizeof(BlockSlim);
+    layout[1] = sizeof(BlockFat);
+    layout[2] = sizeof(Page);
+    layout[3] = REGION_PAGE;
+    layout[4] = NUM_SLOTS;
+    layout[5] = sizeof(Image);
 }
 
-static inline void
-pInsert( ck_Pool* pool, BlockFat* block )
+static bool
+writeAll( int fd, void const* buf, size_t size, uint64_t offset )
 {
-    BlockFat** pPtr = &pool->pSchedule[block->pSlot];;
-    block->pNext = *pPtr;
-    block->pRef  = pPtr;
-    if( block->pNext != NULL )
-        block->pNext->pRef = &block->pNext;
-    *pPtr = block;
+#if CK_HAVE_MMAP
+    while( size > 0 )
+    {
+        ssize_t done = pwrite( fd, buf, size, offset );
+        if( done <= 0 )
+            return false;
+        buf    += done;
+        size   -= done;
+        offset += done;
+    }
+    return true;
+#else
+    return false;
+#endif
 }
 
-static inline void
-pExtract( BlockFat* block )
+static bool
+readAll( int fd, void* buf, size_t size, uint64_t offset )
 {
-    *block->pRef = block->pNext;
-    if( block->pNext != NULL )
-        block->pNext->pRef = block->pRef;
-    block->pRef  = NULL;
-    block->pNext = NULL;
+#if CK_HAVE_MMAP
+    while( size > 0 )
+    {
+        ssize_t done = pread( fd, buf, size, offset );
+        if( done <= 0 )
+            return false;
+        buf    += done;
+        size   -= done;
+        offset += done;
+    }
+    return true;
+#else
+    return false;
+#endif
 }
 
-static inline void
-doExpire( ck_Pool* pool, BlockSlim* block )
+static void*
+imageReserve( ImageMap* maps, size_t nMaps, bool fixed )
 {
-    eExtract( block );
-    if( isFat( block ) )
+#if CK_HAVE_MMAP
+    // reserves the span the mappings were in, at the same
+    // address or anywhere with the same chunk alignment,
+    // then gives back the parts between the mappings
+    if( nMaps == 0 )
+        return (void*)REGION_CHUNK;
+    
+    uintptr_t low  = UINTPTR_MAX;
+    uintptr_t high = 0;
+    for( size_t i = 0 ; i < nMaps ; i++ )
     {
-        BlockFat* fat = slimToFat( block );
-        pExtract( fat );
+        uintptr_t addr = (uintptr_t)maps[i].addr;
+        if( addr < low )
+            low = addr;
+        if( addr + maps[i].size > high )
+            high = addr + maps[i].size;
     }
+    low &= ~(uintptr_t)(REGION_CHUNK - 1);
     
-    
-    if( pool->config.expire )
-        pool->config.expire( pool->config.context, slimToPtr( block ) );
-    
-    pool->used -= decompressSize( getSize( block ) );
-    if( isFat( block ) )
+    size_t span = high - low;
+    void*  base;
+    if( fixed )
     {
-        pool->used -= sizeof(BlockFat);
-        pool->config.alloc( pool->config.context,
-                            slimToFat(block),
-                            0 );
+        int extra = 0;
+#ifdef MAP_FIXED_NOREPLACE
+        extra = MAP_FIXED_NOREPLACE;
+#endif
+        base = mmap( (void*)low, span,
+                     PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | extra,
+                     -1, 0 );
+        if( base == MAP_FAILED )
+            return NULL;
+        if( base != (void*)low )
+        {
+            munmap( base, span );
+            return NULL;
+        }
     }
     else
     {
-        pool->used -= sizeof(BlockSlim);
-        pool->config.alloc( pool->config.context,
-                            block,
-                            0 );
+        base = mapAligned( span, REGION_CHUNK );
+        if( base == NULL )
+            return NULL;
+    }
+    
+    // everything not covered by a mapping is given back,
+    // walking the span in address order
+    uintptr_t at = low;
+    while( at < high )
+    {
+        uintptr_t next = high;
+        uintptr_t end  = 0;
+        for( size_t i = 0 ; i < nMaps ; i++ )
+        {
+            uintptr_t addr = (uintptr_t)maps[i].addr;
+            if( addr >= at && addr < next )
+            {
+                next = addr;
+                end  = addr + maps[i].size;
+            }
+        }
+        if( next > at )
+            munmap( base + (at - low), next - at );
+        at = next < high ? end : high;
     }
+    return base;
+#else
+    return NULL;
+#endif
 }
 
-static inline void
-doPreserve( ck_Pool* pool, BlockFat* block )
+static void
+imageAdopt( ck_Pool* pool, ImageMap* maps, size_t nMaps, ptrdiff_t delta )
 {
-    pExtract( block );
+    // rebuilds the heap's bookkeeping from the page headers;
+    // these are the only parts of the image touched up front
+    Heap* heap = &pool->heap;
+    for( size_t i = 0 ; i < nMaps ; i++ )
+    {
+        void* addr = maps[i].addr + delta;
+        if( maps[i].large )
+        {
+            Page* page = addr;
+            page->next = heap->large;
+            page->ref  = &heap->large;
+            if( page->next != NULL )
+                page->next->ref = &page->next;
+            heap->large = page;
+            heap->resident += page->span;
+            if( (pool->config.flags & CK_SCAN_STACKS) && !mapPages( pool, page, page->span, page ) )
+                pool->mapLost = true;
+            continue;
+        }
+        
+        Chunk* chunk = pool->config.alloc( pool->config.context,
+                                           NULL,
+                                           sizeof(*chunk) );
+        if( chunk == NULL )
+        {
+            // the chunk can't be reused, but its pages
+            // are still good for the blocks in them; the
+            // page map doesn't get them either
+            pool->mapLost = true;
+            continue;
+        }
+        chunk->base  = addr;
+        chunk->nFree = 0;
+        memcpy( chunk->free, maps[i].free, sizeof(chunk->free) );
+        chunk->next  = heap->chunks;
+        heap->chunks = chunk;
+        
+        for( uint idx = 0 ; idx < CHUNK_PAGES ; idx++ )
+        {
+            if( chunk->free[idx / 64] & (uint64_t)1 << idx % 64 )
+            {
+                chunk->nFree++;
+                continue;
+            }
+            
+            Page* page = addr + idx * REGION_PAGE;
+            page->chunk = chunk;
+            page->next  = NULL;
+            page->ref   = NULL;
+            page->evac  = false;
+            pageLink( heap, page );
+            heap->resident += REGION_PAGE;
+            
+            // without its pages in the map the stack scans
+            // can't find anything, so they find everything
+            if( (pool->config.flags & CK_SCAN_STACKS) && !mapPages( pool, page, REGION_PAGE, page ) )
+                pool->mapLost = true;
+            
+            if( page->slab )
+            {
+                page->slabNext = heap->slabs;
+                page->slabRef  = &heap->slabs;
+                if( page->slabNext != NULL )
+                    page->slabNext->slabRef = &page->slabNext;
+                heap->slabs = page;
+            }
+        }
+    }
+}
+
+static void
+imageRelink( ck_Pool* pool, ptrdiff_t delta )
+{
+    // the first block of each list points back into the old
+    // pool; if the image moved then every link needs shifting
+    // as well, which means visiting every block
+    BlockSlim** eLists[NUM_SLOTS + FAR_CYCLES + 1 + FROZEN_SETS];
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+        eLists[i] = &pool->eSchedule[i];
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+        eLists[NUM_SLOTS + i] = &pool->eFar[i];
+    eLists[NUM_SLOTS + FAR_CYCLES] = &pool->roots;
+    for( uint i = 0 ; i < FROZEN_SETS ; i++ )
+        eLists[NUM_SLOTS + FAR_CYCLES + 1 + i] = &pool->frozen[i].blocks;
     
-    // move the block's preservation slot to the next cycle
-    setPreserveSlot( pool, block );
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES + 1 + FROZEN_SETS ; i++ )
+    {
+        BlockSlim** ref = eLists[i];
+        for( BlockSlim* block = *ref ; block ; block = block->eNext )
+        {
+            block->eRef = ref;
+            ref = &block->eNext;
+            if( delta == 0 )
+                break;
+            
+            // weak handles aren't part of the image
+            block->eNext = shift( block->eNext, delta );
+            setFlag( block, FLAG_WEAK, false );
+            if( isFat( block ) )
+                slimToFat( block )->owner = shift( slimToFat( block )->owner, delta );
+        }
+    }
     
-    pInsert( pool, block );
+    BlockFat** pLists[NUM_SLOTS + FAR_CYCLES + FROZEN_SETS];
+    for( uint i = 0 ; i < NUM_SLOTS ; i++ )
+        pLists[i] = &pool->pSchedule[i];
+    for( uint i = 0 ; i < FAR_CYCLES ; i++ )
+        pLists[NUM_SLOTS + i] = &pool->pFar[i];
+    for( uint i = 0 ; i < FROZEN_SETS ; i++ )
+        pLists[NUM_SLOTS + FAR_CYCLES + i] = &pool->frozen[i].fats;
     
-    // cycle detection, if we find a cycle then
-    // we orphanize all the blocks involved; if
-    // one of them receives a ref from outside
-    // the cycle then all will be unorphanized
-    // by an immediate preservation
-    block->cycleCD--;
-    if( block->owner != NULL && block->cycleCD == 0 )
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES + FROZEN_SETS ; i++ )
     {
-        BlockFat* oIter = block->owner;
-        while( oIter != NULL && oIter != block )
-            oIter = oIter->owner;
-        if( oIter == block )
+        BlockFat** ref = pLists[i];
+        for( BlockFat* block = *ref ; block ; block = block->pNext )
         {
-            do
-            {
-                BlockFat* orphan = oIter;
-                oIter = oIter->owner;
-                toOrphan( pool, orphan );
-            } while( oIter != block );
+            block->pRef = ref;
+            ref = &block->pNext;
+            if( delta == 0 )
+                break;
+            block->pNext = shift( block->pNext, delta );
         }
-        
-        block->cycleCD = CK_CYCLE_DETECT_COUNTDOWN;
     }
     
+    if( delta == 0 )
+        return;
     
-    if( pool->config.preserve )
-        pool->config.preserve( pool->config.context, fatToPtr(block), pool );
+    // dead blocks only need their own links, a forwarder's
+    // 'eRef' is the block it was moved to
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES + FORWARD_CYCLES ; i++ )
+    {
+        BlockSlim* block;
+        if( i < NUM_SLOTS )
+            block = pool->tombs[i];
+        else
+        if( i < NUM_SLOTS + FAR_CYCLES )
+            block = pool->tombsFar[i - NUM_SLOTS];
+        else
+            block = pool->forwards[i - NUM_SLOTS - FAR_CYCLES];
+        for( ; block ; block = block->eNext )
+        {
+            block->eNext = shift( block->eNext, delta );
+            block->eRef  = shift( block->eRef, delta );
+            if( isFat( block ) )
+                slimToFat( block )->owner = shift( slimToFat( block )->owner, delta );
+        }
+    }
 }
 
-static inline void
-toOrphan( ck_Pool* pool, BlockFat* block )
+static void
+imageRestore( ck_Pool* pool, ptrdiff_t delta )
 {
-    pExtract( block );
-    setOrphan( fatToSlim(block), true );
-    block->pNext = pool->orphans;
-    block->pRef  = &pool->orphans;
-    if( block->pNext != NULL )
-        block->pNext->pRef = &block->pNext;
-    pool->orphans = block;
-    block->owner  = NULL;
+    void* context = pool->config.context;
+    for( uint i = 0 ; i < NUM_SLOTS + FAR_CYCLES + 1 + FROZEN_SETS ; i++ )
+    {
+        BlockSlim* block;
+        if( i < NUM_SLOTS )
+            block = pool->eSchedule[i];
+        else
+        if( i < NUM_SLOTS + FAR_CYCLES )
+            block = pool->eFar[i - NUM_SLOTS];
+        else
+        if( i == NUM_SLOTS + FAR_CYCLES )
+            block = pool->roots;
+        else
+            block = pool->frozen[i - NUM_SLOTS - FAR_CYCLES - 1].blocks;
+        for( ; block ; block = block->eNext )
+            pool->config.restore( context, slimToPtr( block ), delta );
+    }
+    
+    for( Page* page = pool->heap.slabs ; page ; page = page->slabNext )
+    {
+        for( uint idx = 0 ; idx < page->cap ; idx++ )
+        {
+            if( page->bits[idx / 64] & (uint64_t)1 << idx % 64 )
+            {
+                void* alloc = (void*)page + page->base + idx * CLASS_SIZES[page->klass];
+                pool->config.restore( context, alloc, delta );
+            }
+        }
+    }
 }
 
-static inline void
-toRoot( ck_Pool* pool, BlockSlim* block )
+static inline void*
+shift( void* ptr, ptrdiff_t delta )
 {
-    setRoot( block, true );
-    block->eNext = pool->roots;
-    block->eRef  = &pool->roots;
-    if( block->eNext != NULL )
-        block->eNext->eRef = &block->eNext;
-    pool->roots = block;
-    
-    if( isFat( block ) )
+    return ptr ? ptr + delta : NULL;
+}
+
+// API traces
+
+static void
+recOp( ck_Pool* pool, uint op )
+{
+    // a failed flush ends the recording, the caller checks
+    // 'recBuf' before writing the rest of the record
+    if( pool->recLen + REC_MAX_OP > REC_BUFFER && !recFlush( pool ) )
     {
-        BlockFat* fat = slimToFat(block);
-        fat->owner  = NULL;
+        pool->config.alloc( pool->config.context, pool->recBuf, 0 );
+        pool->recBuf = NULL;
+        return;
     }
+    pool->recBuf[pool->recLen++] = op;
 }
 
-static inline bool
-shouldRef( ck_Pool* pool, BlockFat* owner, BlockSlim* block )
+static inline void
+recNum( ck_Pool* pool, uint64_t num )
 {
-    if( isOrphan( block ) )
-        return true;
-    if( isBefore( pool, block->eSlot, owner->pSlot ) )
-        return true;
-    return false;
+    if( pool->recBuf == NULL )
+        return;
+    
+    while( num >= 0x80 )
+    {
+        pool->recBuf[pool->recLen++] = num | 0x80;
+        num >>= 7;
+    }
+    pool->recBuf[pool->recLen++] = num;
 }
 
 static inline void
-setPreserveSlot( ck_Pool* pool, BlockFat* block )
+recAddr( ck_Pool* pool, void* addr )
 {
-    // preserve slot is set to a random slot after
-    // the expiration slot; since we have a limited
-    // number of slots, the 'after' means that the
-    // slot is in the range between the block's
-    // expiration time and the current clock, starting
-    // at the expiration and overflowing at the max.
-    // This actually results in some clustering of expiration
-    // events as the distance between the current clock
-    // and expiration increase, but the alternative is
-    // complete randomization which results in objects
-    // living for much longer than necessary sice the propegation
-    // of a dropped reference could take up to NUM_SLOTS^CHAIN_LEN
-    // ticks; where CHAIN_LEN is the number of references from
-    // the initial drop to the end of the chain
-    
-    Slot now = pool->clock % NUM_SLOTS;
-    Slot rnd = RAND_NUMS[pool->rand++ % RAND_COUNT] % NUM_SLOTS;
-    Slot max = now - 2;
-    Slot min;
-    if( isRoot(fatToSlim(block)) )
-        min = now + 1;
-    else
-        min = block->slim.eSlot;
+    // NULL and CK_TEMP get their own codes, the rest are
+    // zigzag coded distances from the last address, which
+    // tend to be short since allocations come in runs
+    uintptr_t now = (uintptr_t)addr;
+    if( now <= (uintptr_t)CK_TEMP )
+    {
+        recNum( pool, now );
+        return;
+    }
     
-    if( min == max )
-        block->pSlot = min;
-    else
-    if( max > min )
-        block->pSlot = (min + rnd % (max-min)) % NUM_SLOTS;
-    else
-        block->pSlot = (min + rnd % (NUM_SLOTS-min+max)) % NUM_SLOTS;
+    int64_t diff = (int64_t)(now - pool->recLast);
+    pool->recLast = now;
+    recNum( pool, ((uint64_t)diff << 1 ^ (uint64_t)(diff >> 63)) + 2 );
 }
 
-static inline bool
-isBefore( ck_Pool* pool, Slot before, Slot after )
+static bool
+recFlush( ck_Pool* pool )
 {
-    Slot slot = pool->clock % NUM_SLOTS;
-    if( slot < after && before >= slot && before < after )
-        return true;
-    if( slot > after && before < after )
-        return true;
-    if( slot > after && before >= slot )
-        return true;
-    
+#if CK_HAVE_MMAP
+    uchar* buf  = pool->recBuf;
+    size_t size = pool->recLen;
+    while( size > 0 )
+    {
+        ssize_t done = write( pool->recFd, buf, size );
+        if( done <= 0 )
+            return false;
+        buf  += done;
+        size -= done;
+    }
+    pool->recLen = 0;
+    return true;
+#else
     return false;
+#endif
 }
-
@@ -24,6 +24,11 @@
 #ifndef clok_h
 #define clok_h
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* set to 1 to enable packing of block headers,
  * this can significantly reduce overhead but will
@@ -44,9 +49,198 @@
  */
 #define CK_CYCLE_DETECT_COUNTDOWN (4)
 
+/* number of allocation tags, see ck_allocSlimTagged(); the
+ * tag is kept in spare header bits, so this can't be raised
+ */
+#define CK_MAX_TAGS (16)
+
+/* pass as the 'owner' of an allocation to give it no owner
+ * at all, rather than making it a root; it'll expire a cycle
+ * later unless it's ref'd or kept on the root stack, see
+ * ck_pushRoot()
+ */
+#define CK_TEMP ((void*)1)
+
+/* set to 1 if the platform provides mmap() and madvise(),
+ * this is required for the built-in region heap; without
+ * it the CK_REGION_HEAP flag is ignored and all blocks go
+ * through the config's 'alloc' callback.
+ */
+#ifndef CK_HAVE_MMAP
+#  if defined(__unix__) || defined(__APPLE__)
+#    define CK_HAVE_MMAP (1)
+#  else
+#    define CK_HAVE_MMAP (0)
+#  endif
+#endif
+
+/* set to 1 if the platform provides timerfd_create(), for
+ * ck_getTimerFd(); without it there's no timer to wait on,
+ * but ck_onIdle() still works
+ */
+#ifndef CK_HAVE_TIMERFD
+#  if defined(__linux__)
+#    define CK_HAVE_TIMERFD (1)
+#  else
+#    define CK_HAVE_TIMERFD (0)
+#  endif
+#endif
+
+/* set to 1 to release empty region pages with MADV_FREE
+ * instead of MADV_DONTNEED where available.  MADV_FREE is
+ * cheaper but the kernel only reclaims the pages under
+ * memory pressure, so the process RSS won't drop right away.
+ */
+#ifndef CK_LAZY_RELEASE
+#  define CK_LAZY_RELEASE (0)
+#endif
+
+/* pool flags, these can be or'ed together into the
+ * config's 'flags' field to enable optional features
+ */
+enum
+{
+    /* allocate blocks from a built-in region heap of
+     * mmap'd chunks instead of the 'alloc' callback,
+     * pages that become empty are returned to the OS
+     */
+    CK_REGION_HEAP = 1 << 0,
+    
+    /* ask for transparent huge pages on region heap
+     * chunks; empty pages are then only released once
+     * their whole chunk is empty, since releasing single
+     * pages would split the huge page
+     */
+    CK_HUGE_PAGES  = 1 << 1,
+    
+    /* don't call the 'expire' callback during collection,
+     * instead expired blocks are queued up and finalized
+     * later by ck_runFinalizers(); the blocks still count
+     * toward the quota until they've been freed
+     */
+    CK_DEFER_FINALIZE = 1 << 2,
+    
+    /* move blocks out of sparse region heap pages so the
+     * pages can be released; blocks are only moved by
+     * ck_refMove(), which every reference has to go through.
+     * implies CK_REGION_HEAP
+     */
+    CK_COMPACT = 1 << 3,
+    
+    /* allocate non-root slim blocks from slab pages that keep
+     * their expiration times in a byte array beside the blocks,
+     * instead of giving each block a header; refs to them are
+     * a single store and they're expired by a vectorized sweep
+     * of the arrays.  implies CK_REGION_HEAP, and is ignored
+     * along with CK_DEFER_FINALIZE
+     */
+    CK_SLAB_SLIM = 1 << 4,
+    
+    /* adaptive preservation periods; each time a block is
+     * preserved with the same owner its period doubles, up to
+     * 32 cycles, so stable structures cost next to nothing to
+     * keep.  a block goes back to a one cycle period when
+     * it's ref'd by a new owner.  the catch is that garbage
+     * held by a stable block can take just as long to expire.
+     * CK_SLAB_SLIM is ignored along with this flag.
+     */
+    CK_ADAPTIVE = 1 << 5,
+    
+    /* conservatively scan the stacks given to ck_addStack()
+     * once per tick, any word that points into a block keeps
+     * it from expiring in that tick; so a block only held by
+     * a local doesn't need to be rooted or ref'd.  implies
+     * CK_REGION_HEAP, since the heap's page map is how words
+     * are looked up, and CK_COMPACT is ignored along with it
+     * as the words can't be updated when a block moves
+     */
+    CK_SCAN_STACKS = 1 << 6,
+    
+    /* when an allocation still doesn't fit after a cycle of
+     * collection, run ck_collectAll() before giving up on it;
+     * anything the allocation's caller holds has to be safe
+     * from that, see ck_collectAll()
+     */
+    CK_COLLECT_ALL = 1 << 7
+};
+
 typedef struct ck_Pool  ck_Pool;
 typedef struct ck_CbSet ck_CbSet;
 typedef struct ck_Config ck_Config;
+typedef struct ck_Weak   ck_Weak;
+typedef struct ck_Shortfall ck_Shortfall;
+
+/* a time source for ck_useTime(), returns the current time
+ * in whatever units it likes; it's passed the config's
+ * 'context'
+ */
+typedef uint64_t (*ck_Time)( void* context );
+
+/* collection events, returned by ck_nextEvents() for
+ * users that want to run the callbacks themselves
+ */
+enum ck_Event
+{
+    /* the current tick is done and the clock has advanced */
+    CK_EVENT_TICK,
+    
+    /* the allocations are due for preservation, references
+     * should be ck_ref'd just like in the 'preserve' callback
+     */
+    CK_EVENT_PRESERVE,
+    
+    /* the allocations have expired and should be cleaned up
+     * like in the 'expire' callback; they're freed at the
+     * next call to ck_nextEvents()
+     */
+    CK_EVENT_EXPIRE
+};
+typedef enum ck_Event ck_Event;
+
+/* records in a trace written by ck_record(), each is an op
+ * byte followed by its arguments as LEB128 varints.  an
+ * allocation is named by its address; NULL is written as 0
+ * and CK_TEMP as 1, any other address 'a' as 2 plus the
+ * zigzag coded difference between 'a' and the last address
+ * written.  the trace starts with "clokrec" and a NUL
+ */
+enum ck_TraceOp
+{
+    CK_OP_ALLOC_SLIM,       /* size, tag, owner, alloc */
+    CK_OP_ALLOC_FAT,        /* size, tag, owner, alloc */
+    CK_OP_REF,              /* alloc, owner */
+    CK_OP_MOVE,             /* old, new; by ck_refMove() */
+    CK_OP_UNROOT,           /* alloc, owner */
+    CK_OP_PUSH_ROOT,        /* alloc */
+    CK_OP_POP_ROOT,
+    CK_OP_SCOPE_RELEASE,    /* mark */
+    CK_OP_CYCLE,
+    CK_OP_TICK,             /* also a tick through ck_nextEvents() */
+    CK_OP_STEP,
+    CK_OP_ADVANCE,          /* maxTicks */
+    CK_OP_RESERVE,          /* amount, tag */
+    CK_OP_PRESERVE,         /* alloc; the refs it makes follow */
+    CK_OP_FREEZE,           /* root; its set's preservations follow */
+    CK_OP_THAW,             /* root */
+    CK_OP_COLLECT_ALL       /* its preservations follow */
+};
+typedef enum ck_TraceOp ck_TraceOp;
+
+/* why a ck_tryAllocSlim() or ck_tryAllocFat() failed */
+struct ck_Shortfall
+{
+    /* bytes the quota (or the tag's quota) is short by, zero
+     * if the allocation didn't fail for lack of room
+     */
+    size_t bytes;
+    
+    /* the soonest tick by which enough could be freed, as
+     * ck_forecast() gives it.  zero if the shortfall is all
+     * waiting on finalizers, and UINT_MAX if a cycle won't
+     * free enough or the allocation is bigger than the quota
+     */
+    unsigned ticks;
+};
 
 struct ck_Config
 {
@@ -99,6 +293,22 @@ struct ck_Config
      * NULL is generally sufficient.
      */
     void* context;
+    
+    /* optional features, a combination of the CK_* pool
+     * flags above; zero gives the classic behavior
+     */
+    unsigned flags;
+    
+    /* called by ck_loadPool() for every live allocation in
+     * the image, to fix up any state outside of the pool that
+     * the allocation refers to.  if the image couldn't be
+     * mapped at its original address then all of it has been
+     * moved by 'delta' bytes, and pointers between the pool's
+     * allocations have to be adjusted here too; the image
+     * only loads at a new address if this is set.  can be
+     * NULL otherwise.
+     */
+    void (*restore)( void* context, void* alloc, ptrdiff_t delta );
 };
 
 /* allocates a new memory pool given the
@@ -143,6 +353,61 @@ ck_allocSlim( ck_Pool* pool, size_t size, void* owner );
 void* 
 ck_allocFat( ck_Pool* pool, size_t size, void* owner );
 
+/* same as ck_allocSlim() and ck_allocFat(), but the block
+ * counts against the sub-quota of 'tag' as well as the pool's
+ * quota, see ck_setTagQuota().  untagged blocks are tag 0;
+ * tags must be below CK_MAX_TAGS or NULL is returned.  with
+ * CK_SLAB_SLIM only untagged slim blocks go in slabs.
+ */
+void*
+ck_allocSlimTagged( ck_Pool* pool, size_t size, void* owner, unsigned tag );
+
+void*
+ck_allocFatTagged( ck_Pool* pool, size_t size, void* owner, unsigned tag );
+
+/* same as ck_allocSlim() and ck_allocFat() but these never
+ * collect; if the allocation doesn't fit in the quota then
+ * they return NULL right away, and if 'status' isn't NULL it
+ * says how far off the allocation was.  finalized blocks of a
+ * CK_DEFER_FINALIZE pool are still freed.
+ */
+void*
+ck_tryAllocSlim( ck_Pool* pool, size_t size, void* owner, ck_Shortfall* status );
+
+void*
+ck_tryAllocFat( ck_Pool* pool, size_t size, void* owner, ck_Shortfall* status );
+
+/* allocates 'n' objects that live and die together as one fat
+ * block, with 'sizes[i]' bytes for the i'th; their addresses
+ * go in 'out' and the first is returned, or NULL if the group
+ * can't be allocated.  the group has a single header and is
+ * scheduled as one block, so members after the first only
+ * cost a few bytes each.  any member can be passed to the API
+ * in place of the group, a ref to one keeps them all alive,
+ * but the callbacks only ever get the first; its preserve
+ * call has to ref everything the whole group holds.
+ */
+void*
+ck_allocGroup( ck_Pool* pool, size_t const* sizes, size_t n, void* owner, void** out );
+
+/* copies 'size' bytes from 'data' into a slim block, unless an
+ * interned block already has the same bytes; then that block is
+ * ref'd for 'owner' and returned, so equal blobs end up with one
+ * address.  interned blocks are shared and shouldn't be changed,
+ * they're forgotten when they expire.  returns NULL if a new
+ * block was needed and couldn't be allocated.
+ */
+void*
+ck_internSlim( ck_Pool* pool, void const* data, size_t size, void* owner );
+
+/* allocates a slim block that nothing owns, it expires once
+ * 'ttl' has passed (see ck_useTime()) unless it's ref'd by
+ * then; so a cache entry costs nothing to keep track of.
+ * TTLs are capped at 63 cycles, and at one in a slab.
+ */
+void*
+ck_allocSlimTTL( ck_Pool* pool, size_t size, uint64_t ttl );
+
 
 /* references an object, expanding its expiration time
  * by the owner's (referencing object's) presevation
@@ -158,6 +423,20 @@ ck_allocFat( ck_Pool* pool, size_t size, void* owner );
 void
 ck_ref( ck_Pool* pool, void* alloc, void* owner );
 
+/* same as ck_ref() but returns the allocation's address,
+ * which the owner should store in place of the one it
+ * passed in.  with CK_COMPACT the allocation may have been
+ * moved to a denser page; the old address still works with
+ * ck_refMove() for at least two more cycles, but with
+ * nothing else, so in a compacting pool every reference
+ * should be refreshed with this instead of ck_ref().  roots,
+ * allocations with a preservation under way and the owner
+ * of an allocation in progress are never moved.  without
+ * CK_COMPACT this returns 'alloc'
+ */
+void*
+ck_refMove( ck_Pool* pool, void* alloc, void* owner );
+
 /* unroots an allocation, the 'owner' field should
  * be the only referencing object at the time of
  * demotion.  the 'ck_ref' function should be called
@@ -166,11 +445,97 @@ ck_ref( ck_Pool* pool, void* alloc, void* owner );
  * additional reference in existance upon demotion.
  * if the 'owner' argument is the same as 'alloc'
  * the function will do nothing; so the owner should
- * not be the allocation itself.
+ * not be the allocation itself.  the 'owner' can be
+ * NULL if the allocation's existing referencers are
+ * all preserving it, it's given a full cycle before
+ * expiring either way, or 32 with CK_ADAPTIVE.
  */
 void
 ck_unroot( ck_Pool* pool, void* alloc, void* owner );
 
+/* takes the root 'root' and everything reachable from it out
+ * of collection; each fat block is preserved once more, and
+ * whatever it refs is frozen along with it, after that they're
+ * never preserved or expired until the set is thawed.  a block
+ * ref'd by, or allocated for, a frozen owner later on is frozen
+ * with it.  roots and blocks in other frozen sets are left as
+ * they are, so sets shouldn't share blocks, and frozen blocks
+ * shouldn't hold blocks in other pools.  unrooting the root
+ * only takes effect when it's thawed.  there can be 16 sets
+ * at once; returns zero, or -1 if 'root' isn't a root or
+ * there's no set left for it
+ */
+int
+ck_freeze( ck_Pool* pool, void* root );
+
+/* returns a set frozen by ck_freeze() to collection; 'root'
+ * goes back to being a root, if it hasn't been unrooted, and
+ * the rest are given a cycle to be ref'd again, like after
+ * ck_unroot().  returns -1 if 'root' isn't a frozen set's root
+ */
+int
+ck_thaw( ck_Pool* pool, void* root );
+
+/* same as ck_ref() but for an 'owner' in the pool 'from',
+ * which is the pool the calling thread collects; so pools on
+ * different threads can share blocks.  the ref is queued
+ * without a lock and applied by 'pool' at the start of its
+ * next tick, so the pools have to tick at about the same
+ * rate, a pool that gets more than a few ticks ahead of the
+ * others can expire the blocks they hold.  a block held this
+ * way shouldn't be in a CK_COMPACT pool, since its holders
+ * can't be given its new address.  queued refs have to be
+ * drained before 'from' is freed.  returns zero, or -1 if the
+ * ref couldn't be queued or 'owner' is NULL or CK_TEMP; a
+ * block is made a root from its own pool.
+ */
+int
+ck_refRemote( ck_Pool* pool, void* alloc, ck_Pool* from, void* owner );
+
+/* keeps an allocation for at least 'ttl' from now, like a
+ * ref from an owner that far out; it never brings the
+ * allocation's expiration any closer.  a hit on a cache
+ * entry calls this to push its TTL back
+ */
+void
+ck_refTTL( ck_Pool* pool, void* alloc, uint64_t ttl );
+
+/* the root stack, a cheaper way to keep temporaries alive
+ * than making them roots.  the allocation is kept from
+ * expiring for as long as it's on the stack, and once it's
+ * popped it has the rest of a cycle to be ref'd by another
+ * block before it expires.  ck_pushRoot() returns 'alloc',
+ * or NULL if the stack couldn't grow.  ck_scopeMark() gives
+ * the current depth, which ck_scopeRelease() pops back to.
+ * blocks on the stack aren't moved by CK_COMPACT.
+ */
+void*
+ck_pushRoot( ck_Pool* pool, void* alloc );
+
+void
+ck_popRoot( ck_Pool* pool );
+
+size_t
+ck_scopeMark( ck_Pool* pool );
+
+void
+ck_scopeRelease( ck_Pool* pool, size_t mark );
+
+/* adds a stack for CK_SCAN_STACKS to scan, bounded by 'lo'
+ * and 'hi'.  if the collecting thread's stack pointer is in
+ * the range then only the part above it is scanned; 'lo' can
+ * be NULL for the collecting thread's own stack, which is
+ * then always scanned from the stack pointer up.  any other
+ * stack has to stay put while the pool collects.  returns
+ * zero, or -1 if the range couldn't be added
+ */
+int
+ck_addStack( ck_Pool* pool, void const* lo, void const* hi );
+
+/* removes a stack added with the same 'hi' */
+void
+ck_removeStack( ck_Pool* pool, void const* hi );
+
 /* invokes a full garbage collection cycle, in most
  * cases this will collect all garbage in the pool,
  * unless additional allocations are made in 'expire'
@@ -193,13 +558,76 @@ ck_tick( ck_Pool* pool );
 /* invokes a single step of collection, this is a single
  * garbage collection action, either invoking the 'preserve'
  * callback, invoking the 'expire' callback, or incrementing
- * the tick counter.  invokation of this function should be
+ * the tick counter past the current tick and any empty ones
+ * after it.  invokation of this function should be
  * virtually instantaneous, though the compute time of the
  * callbacks will play a role.
  */
 void
 ck_step( ck_Pool* pool );
 
+/* moves the clock past up to 'maxTicks' ticks that have
+ * nothing due in them, stopping at the first one that does;
+ * returns the number of ticks skipped, which is zero if
+ * the current tick has work.  costs next to nothing per
+ * tick, so an idle pool can be kept going with this and
+ * ck_tick() instead of a tick at a time.  ck_cycle() and
+ * ck_reserve() already skip empty ticks this way.
+ */
+size_t
+ck_advance( ck_Pool* pool, size_t maxTicks );
+
+/* drives the pool's clock from 'now', one tick for every
+ * 'tickTime' of its units; NULL uses the monotonic clock in
+ * nanoseconds.  from then on ck_catchUp() runs whatever
+ * ticks have come due since it was last called, skipping
+ * the empty ones, so a pool that sat idle catches up in
+ * bulk.  TTLs are in the same units, without a time source
+ * they're in ticks.  not saved in pool images.
+ */
+void
+ck_useTime( ck_Pool* pool, ck_Time now, uint64_t tickTime );
+
+/* returns the number of ticks run or skipped */
+size_t
+ck_catchUp( ck_Pool* pool );
+
+/* returns a non-blocking timerfd that becomes readable when
+ * the pool has collection work due; ticks that have come due
+ * by the time source (see ck_useTime()), or less than an
+ * eighth of the quota left with enough due in the next cycle
+ * to make up for it.  it's meant to go in an event loop, which
+ * calls ck_onIdle() when it's readable.  the timer counts the
+ * time source's units as nanoseconds, like the default source
+ * does.  the fd belongs to the pool and is closed with it;
+ * returns -1 if it can't be made
+ */
+int
+ck_getTimerFd( ck_Pool* pool );
+
+/* does due collection work, a block at a time, until there's
+ * none left or the time source reaches 'deadline'; in the time
+ * source's units, or monotonic nanoseconds without one.  due
+ * ticks come first, then under pressure it collects ahead of
+ * the time.  the timer is re-armed for the next work before
+ * returning.  returns the number of steps taken
+ */
+size_t
+ck_onIdle( ck_Pool* pool, uint64_t deadline );
+
+/* performs the next steps of collection without calling the
+ * 'preserve' or 'expire' callbacks, instead up to 'cap' of the
+ * allocations that need attention are put in 'allocs' and their
+ * count is returned, with the kind of event in 'event'; so the
+ * caller can dispatch the callbacks itself, which is how the
+ * C++ wrapper inlines them.  calling this until it returns zero
+ * (with CK_EVENT_TICK) does the same thing as ck_tick().  the
+ * config callbacks are still used for other collection, like
+ * that done by the allocators
+ */
+size_t
+ck_nextEvents( ck_Pool* pool, ck_Event* event, void** allocs, size_t cap );
+
 /* invokes the ck_tick() function until the specified amount
  * of room is available in the quota.  will performa at most
  * one cycle of collection, if the target amount hasn't been
@@ -209,6 +637,58 @@ ck_step( ck_Pool* pool );
 void
 ck_reserve( ck_Pool* pool, size_t amount );
 
+/* same as ck_reserve() but makes room within the sub-quota
+ * of 'tag' as well, as ck_allocSlimTagged() does when the
+ * tag is over budget
+ */
+void
+ck_reserveTagged( ck_Pool* pool, size_t amount, unsigned tag );
+
+/* a full collection, for when a cycle or more is too long to
+ * wait; every block reachable from the roots, the root stack
+ * and the scanned stacks is found by calling 'preserve' on it
+ * once, with its refs only marking what they ref, and all of
+ * the rest expires right away.  the cost is a preservation of
+ * every live block, so it's a last resort rather than a way
+ * to collect.  blocks that are only held by a temporary that
+ * isn't on the root stack, by a TTL or by refs from another
+ * pool are garbage as far as it's concerned, and so is a batch
+ * from ck_nextEvents() that's still being handled.  does
+ * nothing without a 'preserve' callback, or if the stack scan
+ * comes up short.  returns the number of bytes expired
+ */
+size_t
+ck_collectAll( ck_Pool* pool );
+
+/* runs the 'expire' callback for up to 'budget' blocks
+ * waiting in the finalization queue of a CK_DEFER_FINALIZE
+ * pool, and returns how many were run.  this can be called
+ * from any thread, even during collection on another; the
+ * finalized blocks are handed back and freed by the pool's
+ * own thread at its next tick or allocation
+ */
+size_t
+ck_runFinalizers( ck_Pool* pool, size_t budget );
+
+/* returns the number of ticks until at least 'bytes' bytes
+ * could be freed, or UINT_MAX if that's more than a cycle's
+ * worth; zero if the pending blocks cover it.  the pool keeps
+ * a running total of the bytes due in each tick, so this is
+ * cheap and exact as far as what's scheduled goes; blocks that
+ * are ref'd in the meantime can make the real number higher.
+ * ck_reserve() and the allocators use it to give up right
+ * away instead of collecting a cycle for nothing
+ */
+unsigned
+ck_forecast( ck_Pool* pool, size_t bytes );
+
+/* return the number of bytes held by blocks that have
+ * expired but haven't been freed yet, these are included
+ * in ck_used()
+ */
+size_t
+ck_pending( ck_Pool* pool );
+
 /* return the number of bytes left in the quota */
 size_t
 ck_avail( ck_Pool* pool );
@@ -217,4 +697,135 @@ ck_avail( ck_Pool* pool );
 size_t
 ck_used( ck_Pool* pool );
 
+/* return the number of bytes an allocation of 'size' counts
+ * for in the quota, its header and rounding included; slim
+ * blocks in slabs can come out a little different.  SIZE_MAX
+ * if it's too big to allocate
+ */
+size_t
+ck_blockSize( size_t size, int fat );
+
+/* sets the most bytes that blocks with the given tag can hold
+ * at once; an allocation that would go over it collects until
+ * the tag's blocks make room, or fails, just like with the
+ * pool's quota.  allocations with other tags only have to fit
+ * their own tag and the pool.  tags start without a limit.
+ */
+void
+ck_setTagQuota( ck_Pool* pool, unsigned tag, size_t quota );
+
+/* return the number of bytes currently allocated with a tag */
+size_t
+ck_tagUsed( ck_Pool* pool, unsigned tag );
+
+/* creates a weak handle to an allocation, unlike a reference
+ * the handle doesn't keep the allocation alive; once the
+ * allocation expires the handle is cleared and ck_getWeak()
+ * returns NULL.  handles belong to the pool and are freed
+ * along with it, or earlier with ck_freeWeak().
+ */
+ck_Weak*
+ck_makeWeak( ck_Pool* pool, void* alloc );
+
+/* returns the allocation a weak handle points to, or NULL
+ * if it has expired.  the returned pointer is only good
+ * until the next collection, so it should be ck_ref'd by
+ * some owner if it needs to be kept.
+ */
+void*
+ck_getWeak( ck_Pool* pool, ck_Weak* weak );
+
+/* frees a weak handle, whether or not its allocation
+ * is still alive
+ */
+void
+ck_freeWeak( ck_Pool* pool, ck_Weak* weak );
+
+/* return the number of bytes of memory the pool's blocks
+ * are holding from the OS; with the region heap this is
+ * the size of all non-released pages, otherwise it's the
+ * same as ck_used()
+ */
+size_t
+ck_resident( ck_Pool* pool );
+
+/* writes an image of the pool to the file 'fd', which
+ * ck_loadPool() can map back in, in this process or in a
+ * later one.  the pool has to use CK_REGION_HEAP; pending
+ * finalizers are run first, and weak handles aren't saved.
+ * returns 0 on success and -1 on failure.
+ */
+int
+ck_savePool( ck_Pool* pool, int fd );
+
+/* makes a pool from an image written by ck_savePool() with
+ * the same build, using the callbacks and quota of 'config'.
+ * the image's pages are mapped copy-on-write from the file,
+ * so they're only read as they're touched; the file has to
+ * stay as it is while the pool is around, though 'fd' can be
+ * closed.  see the config's 'restore' callback for images
+ * that can't go back to their old address.  returns NULL
+ * on failure.
+ */
+ck_Pool*
+ck_loadPool( ck_Config const* config, int fd );
+
+/* marks the start of a read from another thread; between
+ * this and ck_readExit() the thread can follow pointers
+ * between the pool's allocations without calling ck_ref(),
+ * and none of the ones it can reach will be freed even if
+ * they expire in the meantime.  their memory is only given
+ * back once every reader that was in at the time has left,
+ * which the pool checks at each tick.  returns a ticket to
+ * pass to ck_readExit().  read sections should be short;
+ * up to 64 threads can be in one at once, and any more will
+ * spin until a slot frees up.  the reader mustn't call
+ * anything else on the pool, only the pool's own thread can;
+ * and every reader has to be out before ck_freePool().
+ */
+unsigned
+ck_readEnter( ck_Pool* pool );
+
+void
+ck_readExit( ck_Pool* pool, unsigned ticket );
+
+/* stores up to 'cap' of the pool's roots in 'allocs' and
+ * returns the total number of roots, most recent first;
+ * this is how a loaded pool's roots are found again
+ */
+size_t
+ck_getRoots( ck_Pool* pool, void** allocs, size_t cap );
+
+/* starts recording the pool's allocations, refs, unroots
+ * and collection calls to the file 'fd', see ck_TraceOp;
+ * the 'replay' tool can run the trace against any build
+ * and configuration.  a negative 'fd' stops recording and
+ * flushes what's left, as does ck_freePool().  writes are
+ * buffered, and one that fails ends the recording.  returns
+ * 0 on success and -1 on failure.
+ */
+int
+ck_record( ck_Pool* pool, int fd );
+
+/* puts one in every 'every' allocations in a mapping of its
+ * own, ending at an inaccessible guard page; when the block
+ * is freed the mapping is made inaccessible and kept around
+ * for a while instead of being unmapped.  so a block that's
+ * used after it expired, most likely because a 'preserve'
+ * missed a ck_ref(), faults right away, and the report on
+ * stderr names the block, the tick and slot it expired in
+ * and its last owner; for slim blocks that's the owner it
+ * was allocated for.  overruns of sampled blocks are caught
+ * the same way.  only a few hundred sampled blocks are
+ * live at once, past that allocations aren't sampled until
+ * some expire.  zero stops sampling.  returns 0, or -1 for
+ * a CK_REGION_HEAP pool or without mmap().
+ */
+int
+ck_guard( ck_Pool* pool, unsigned every );
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
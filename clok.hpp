@@ -0,0 +1,478 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Ray Stubbs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef clok_hpp
+#define clok_hpp
+#include "clok.h"
+#include <climits>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+/* header only C++ layer over the C API; the pool's hooks
+ * are taken from a traits class at compile time, so the
+ * collection loops in tick() call them directly and the
+ * compiler is free to inline them, instead of going through
+ * the config's function pointers.  the traits class should
+ * derive from clok::Traits and hide whichever of its static
+ * members it needs to:
+ *
+ *     struct MyTraits : clok::Traits
+ *     {
+ *         static void expire( void* alloc );
+ *         static void preserve( clok::Pool<MyTraits>& pool, void* alloc );
+ *     };
+ */
+namespace clok
+{
+
+template< class Traits >
+class Pool;
+
+template< class T, class Traits >
+class Root;
+
+template< class Traits >
+class Scope;
+
+/* default hooks; memory comes from realloc and the
+ * callbacks do nothing
+ */
+struct Traits
+{
+    /* number of events fetched from the C side at once;
+     * bigger batches save calls but the blocks tend to be
+     * out of cache again by the time their callbacks run
+     */
+    static constexpr size_t batch = 1;
+
+    static void*
+    alloc( void* old, size_t size )
+    {
+        if( size == 0 )
+        {
+            std::free( old );
+            return nullptr;
+        }
+        return std::realloc( old, size );
+    }
+
+    static void
+    expire( void* )
+    {}
+
+    template< class P >
+    static void
+    preserve( P&, void* )
+    {}
+};
+
+template< class Traits >
+class Pool
+{
+public:
+    /* number of ticks in a collection cycle */
+    static constexpr unsigned cycleTicks = 255;
+
+    explicit
+    Pool( size_t quota, unsigned flags = 0 )
+    {
+        ck_Config config;
+        config.quota    = quota;
+        config.alloc    = &allocHook;
+        config.expire   = &expireHook;
+        config.preserve = &preserveHook;
+        config.context  = this;
+        config.flags    = flags;
+        config.restore  = nullptr;
+        pool_ = ck_makePool( &config );
+        if( pool_ == nullptr )
+            throw std::bad_alloc();
+    }
+
+    ~Pool()
+    {
+        ck_freePool( pool_ );
+    }
+
+    // the pool's address is the callbacks' context,
+    // so it has to stay put
+    Pool( Pool const& ) = delete;
+    Pool& operator=( Pool const& ) = delete;
+
+    /* allocates and constructs a fat block, returns NULL
+     * if there's no room in the quota.  T's constructor
+     * shouldn't throw, since the block belongs to the pool
+     * as soon as it's allocated
+     */
+    template< class T, class... Args >
+    T*
+    allocFat( void const* owner, Args&&... args )
+    {
+        reserve( ck_blockSize( sizeof(T), 1 ) );
+        void* mem = ck_allocFat( pool_, sizeof(T), const_cast<void*>( owner ) );
+        if( mem == nullptr )
+            return nullptr;
+        return new (mem) T( std::forward<Args>( args )... );
+    }
+
+    /* same as allocFat() but for slim blocks, which are
+     * never preserved so T shouldn't hold references
+     */
+    template< class T, class... Args >
+    T*
+    allocSlim( void const* owner, Args&&... args )
+    {
+        reserve( ck_blockSize( sizeof(T), 0 ) );
+        void* mem = ck_allocSlim( pool_, sizeof(T), const_cast<void*>( owner ) );
+        if( mem == nullptr )
+            return nullptr;
+        return new (mem) T( std::forward<Args>( args )... );
+    }
+
+    /* same as allocFat() and allocSlim() but they never
+     * collect, see ck_tryAllocFat(); 'status' comes first
+     * since the rest go to T's constructor
+     */
+    template< class T, class... Args >
+    T*
+    tryAllocFat( ck_Shortfall* status, void const* owner, Args&&... args )
+    {
+        void* mem = ck_tryAllocFat( pool_, sizeof(T), const_cast<void*>( owner ), status );
+        if( mem == nullptr )
+            return nullptr;
+        return new (mem) T( std::forward<Args>( args )... );
+    }
+
+    template< class T, class... Args >
+    T*
+    tryAllocSlim( ck_Shortfall* status, void const* owner, Args&&... args )
+    {
+        void* mem = ck_tryAllocSlim( pool_, sizeof(T), const_cast<void*>( owner ), status );
+        if( mem == nullptr )
+            return nullptr;
+        return new (mem) T( std::forward<Args>( args )... );
+    }
+
+    /* allocates a fat block as a root, which is unrooted
+     * when the returned handle goes away
+     */
+    template< class T, class... Args >
+    Root< T, Traits >
+    makeRoot( Args&&... args )
+    {
+        return Root< T, Traits >( *this,
+                                  allocFat<T>( nullptr,
+                                               std::forward<Args>( args )... ),
+                                  true );
+    }
+
+    void
+    ref( void const* alloc, void const* owner )
+    {
+        ck_ref( pool_, const_cast<void*>( alloc ), const_cast<void*>( owner ) );
+    }
+
+    /* see ck_refMove(), returns the block's new address */
+    template< class T >
+    T*
+    refMove( T* alloc, void const* owner )
+    {
+        void* moved = ck_refMove( pool_,
+                                  const_cast<void*>( static_cast<void const*>( alloc ) ),
+                                  const_cast<void*>( owner ) );
+        return static_cast<T*>( moved );
+    }
+
+    void
+    unroot( void const* alloc, void const* owner )
+    {
+        ck_unroot( pool_, const_cast<void*>( alloc ), const_cast<void*>( owner ) );
+    }
+
+    /* see ck_freeze() and ck_thaw() */
+    bool
+    freeze( void const* root )
+    {
+        return ck_freeze( pool_, const_cast<void*>( root ) ) == 0;
+    }
+
+    bool
+    thaw( void const* root )
+    {
+        return ck_thaw( pool_, const_cast<void*>( root ) ) == 0;
+    }
+
+    void
+    tick()
+    {
+        void*    allocs[Traits::batch];
+        ck_Event event;
+        while( size_t count = ck_nextEvents( pool_, &event, allocs, Traits::batch ) )
+        {
+            if( event == CK_EVENT_PRESERVE )
+            {
+                for( size_t i = 0 ; i < count ; i++ )
+                    Traits::preserve( *this, allocs[i] );
+            }
+            else
+            {
+                for( size_t i = 0 ; i < count ; i++ )
+                    Traits::expire( allocs[i] );
+            }
+        }
+    }
+
+    /* skips up to 'maxTicks' empty ticks, see ck_advance() */
+    size_t
+    advance( size_t maxTicks )
+    {
+        return ck_advance( pool_, maxTicks );
+    }
+
+    void
+    cycle()
+    {
+        size_t left = cycleTicks;
+        while( left > 0 )
+        {
+            left -= advance( left );
+            if( left > 0 )
+            {
+                tick();
+                left--;
+            }
+        }
+    }
+
+    /* ticks until 'amount' bytes are available or a full
+     * cycle has passed; the allocators do this themselves,
+     * so anything left over is collected by the C side
+     */
+    void
+    reserve( size_t amount )
+    {
+        // pending blocks are as good as free, see ck_reserve();
+        // and there's no use ticking for what a cycle can't free
+        if( ck_avail( pool_ ) < amount && forecast( amount - ck_avail( pool_ ) ) == UINT_MAX )
+            return;
+        
+        size_t left = cycleTicks;
+        while( left > 0 && ck_avail( pool_ ) + ck_pending( pool_ ) < amount )
+        {
+            left -= advance( left );
+            if( left > 0 )
+            {
+                tick();
+                left--;
+            }
+        }
+    }
+
+    /* see ck_collectAll(), returns the bytes expired */
+    size_t
+    collectAll()
+    {
+        return ck_collectAll( pool_ );
+    }
+
+    /* see ck_forecast() */
+    unsigned
+    forecast( size_t bytes )
+    {
+        return ck_forecast( pool_, bytes );
+    }
+
+    size_t
+    avail()
+    {
+        return ck_avail( pool_ );
+    }
+
+    size_t
+    used()
+    {
+        return ck_used( pool_ );
+    }
+
+    ck_Pool*
+    get()
+    {
+        return pool_;
+    }
+
+private:
+    static void*
+    allocHook( void*, void* old, size_t size )
+    {
+        return Traits::alloc( old, size );
+    }
+
+    static void
+    expireHook( void*, void* alloc )
+    {
+        Traits::expire( alloc );
+    }
+
+    static void
+    preserveHook( void* context, void* alloc, ck_Pool* )
+    {
+        Traits::preserve( *static_cast<Pool*>( context ), alloc );
+    }
+
+    ck_Pool* pool_;
+};
+
+/* owning handle for a root block, the block is rooted for as
+ * long as the handle is around; it shouldn't have more than
+ * one of these since the first to go will unroot it, and the
+ * handles have to go before their pool does
+ */
+template< class T, class Traits >
+class Root
+{
+public:
+    Root()
+    : pool_( nullptr ), alloc_( nullptr )
+    {}
+
+    Root( Pool<Traits>& pool, T* alloc )
+    : pool_( &pool ), alloc_( alloc )
+    {
+        if( alloc_ )
+            pool_->ref( alloc_, nullptr );
+    }
+
+    Root( Root&& other )
+    : pool_( other.pool_ ), alloc_( other.alloc_ )
+    {
+        other.alloc_ = nullptr;
+    }
+
+    Root&
+    operator=( Root&& other )
+    {
+        if( this != &other )
+        {
+            reset();
+            pool_  = other.pool_;
+            alloc_ = other.alloc_;
+            other.alloc_ = nullptr;
+        }
+        return *this;
+    }
+
+    Root( Root const& ) = delete;
+    Root& operator=( Root const& ) = delete;
+
+    ~Root()
+    {
+        reset();
+    }
+
+    /* unroots the block; anything else holding it must
+     * be preserving it by the end of the next cycle
+     */
+    void
+    reset()
+    {
+        if( alloc_ )
+            pool_->unroot( alloc_, nullptr );
+        alloc_ = nullptr;
+    }
+
+    T*
+    get() const
+    {
+        return alloc_;
+    }
+
+    T*
+    operator->() const
+    {
+        return alloc_;
+    }
+
+    T&
+    operator*() const
+    {
+        return *alloc_;
+    }
+
+    explicit
+    operator bool() const
+    {
+        return alloc_ != nullptr;
+    }
+
+private:
+    friend class Pool<Traits>;
+
+    // for blocks that were allocated as roots
+    Root( Pool<Traits>& pool, T* alloc, bool )
+    : pool_( &pool ), alloc_( alloc )
+    {}
+
+    Pool<Traits>* pool_;
+    T*            alloc_;
+};
+
+/* a scope on the pool's root stack, everything pushed through
+ * it is popped when it goes; allocate temporaries with CK_TEMP
+ * as the owner and push them here:
+ *
+ *     clok::Scope<MyTraits> scope( pool );
+ *     Node* tmp = scope.push( pool.allocFat<Node>( CK_TEMP ) );
+ */
+template< class Traits >
+class Scope
+{
+public:
+    explicit
+    Scope( Pool<Traits>& pool )
+    : pool_( pool ), mark_( ck_scopeMark( pool.get() ) )
+    {}
+
+    ~Scope()
+    {
+        ck_scopeRelease( pool_.get(), mark_ );
+    }
+
+    Scope( Scope const& ) = delete;
+    Scope& operator=( Scope const& ) = delete;
+
+    template< class T >
+    T*
+    push( T* alloc )
+    {
+        return static_cast<T*>( ck_pushRoot( pool_.get(), alloc ) );
+    }
+
+private:
+    Pool<Traits>& pool_;
+    size_t        mark_;
+};
+
+}
+
+#endif
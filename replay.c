@@ -0,0 +1,534 @@
+#include "clok.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// replays a trace written by ck_record against this build of
+// the collector, in whatever configuration is asked for.  the
+// trace doesn't have the program's objects, so each block
+// stands in for one, and the preserve callback refs whatever
+// the recorded object was last seen holding: the refs made
+// by its last recorded preservation plus any refs to it from
+// outside a preservation since then.  refs the recorded
+// program made while preserving are left to our own preserve
+// callback instead of being made again
+//
+// usage: replay [-q quota] [-r] [-d] [-c] [-b] [-a] trace
+//     -r  use the region heap
+//     -d  use deferred finalization
+//     -c  use compaction, refs go through ck_refMove
+//     -b  put slim blocks in slabs
+//     -a  use adaptive preservation periods
+
+#define NO_OBJ   (0)
+#define MAX_OPS  (CK_OP_COLLECT_ALL + 1)
+
+typedef struct Obj Obj;
+
+// a recorded allocation, indexed by the id at the start
+// of its block; zero is never used
+struct Obj
+{
+    void*     ptr;
+    unsigned* kids;
+    unsigned  nKids;
+    unsigned  capKids;
+    bool      dead;
+};
+
+// recorded address -> object id, open addressing
+typedef struct
+{
+    uintptr_t addr;
+    unsigned  id;
+} Slot;
+
+static ck_Pool*      pool;
+static Obj*          objs;
+static unsigned      nObjs;
+static unsigned      capObjs;
+static Slot*         slots;
+static size_t        nSlots;
+static size_t        capSlots;
+static unsigned*     batch;
+static unsigned      nBatch;
+static unsigned      capBatch;
+
+static bool          freeing;
+static bool          moving;
+static unsigned long opCounts[MAX_OPS];
+static unsigned long preserves;
+static unsigned long expired;
+static unsigned long missed;
+static size_t        maxUsed;
+
+void*    rAlloc( void* context, void* old, size_t size );
+void     rExpire( void* context, void* alloc );
+void     rPreserve( void* context, void* alloc, ck_Pool* pool );
+void     refObj( unsigned id, unsigned owner );
+void     addKid( unsigned owner, unsigned kid );
+unsigned makeObj( size_t size, unsigned tag, void* own, unsigned owner, bool fat );
+unsigned findObj( uintptr_t addr );
+void     mapObj( uintptr_t addr, unsigned id );
+bool     inBatch( unsigned id );
+uint64_t readNum( uint8_t const** at, uint8_t const* end );
+uintptr_t readAddr( uint8_t const** at, uint8_t const* end, uintptr_t* last );
+void     freeAll( void );
+
+int main( int argc, char** argv )
+{
+    size_t      quota = SIZE_MAX;
+    unsigned    flags = 0;
+    char const* path  = NULL;
+    bool        bad   = false;
+
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        if( !strcmp( argv[i], "-q" ) && i + 1 < argc )
+            quota = strtoull( argv[++i], NULL, 0 );
+        else
+        if( !strcmp( argv[i], "-r" ) )
+            flags |= CK_REGION_HEAP;
+        else
+        if( !strcmp( argv[i], "-d" ) )
+            flags |= CK_DEFER_FINALIZE;
+        else
+        if( !strcmp( argv[i], "-c" ) )
+        {
+            flags |= CK_COMPACT;
+            moving = true;
+        }
+        else
+        if( !strcmp( argv[i], "-b" ) )
+            flags |= CK_SLAB_SLIM;
+        else
+        if( !strcmp( argv[i], "-a" ) )
+            flags |= CK_ADAPTIVE;
+        else
+        if( argv[i][0] != '-' && path == NULL )
+            path = argv[i];
+        else
+            bad = true;
+    }
+    if( bad || path == NULL )
+    {
+        fprintf( stderr, "usage: %s [-q quota] [-r] [-d] [-c] [-b] [-a] "
+                         "trace\n", argv[0] );
+        return 2;
+    }
+
+    // the whole trace is read up front so the timing below
+    // is only the replay
+    FILE* file = fopen( path, "rb" );
+    if( file == NULL )
+    {
+        perror( path );
+        return 1;
+    }
+    fseek( file, 0, SEEK_END );
+    long     size  = ftell( file );
+    uint8_t* trace = malloc( size > 0 ? size : 1 );
+    fseek( file, 0, SEEK_SET );
+    if( size < 8 || fread( trace, 1, size, file ) != (size_t)size ||
+        memcmp( trace, "clokrec", 8 ) )
+    {
+        fprintf( stderr, "%s: not a trace\n", path );
+        fclose( file );
+        free( trace );
+        return 1;
+    }
+    fclose( file );
+
+    ck_Config config = { .quota    = quota,
+                         .alloc    = &rAlloc,
+                         .expire   = &rExpire,
+                         .preserve = &rPreserve,
+                         .context  = NULL,
+                         .flags    = flags };
+    pool = ck_makePool( &config );
+    nObjs = 1;
+
+    uint8_t const* at   = trace + 8;
+    uint8_t const* end  = trace + size;
+    uintptr_t      last = 0;
+    int            prev = -1;
+    clock_t        t0   = clock();
+    while( at < end )
+    {
+        int op = *at++;
+        if( op >= MAX_OPS )
+        {
+            fprintf( stderr, "%s: bad op %d at %ld\n", path, op,
+                     (long)(at - trace - 1) );
+            freeAll();
+            free( trace );
+            return 1;
+        }
+        opCounts[op]++;
+
+        // a run of preservations ends at anything but a ref
+        if( op != CK_OP_PRESERVE && op != CK_OP_REF && op != CK_OP_MOVE )
+            nBatch = 0;
+
+        switch( op )
+        {
+            case CK_OP_ALLOC_SLIM:
+            case CK_OP_ALLOC_FAT:
+            {
+                size_t    bytes = readNum( &at, end );
+                unsigned  tag   = readNum( &at, end );
+                uintptr_t owner = readAddr( &at, end, &last );
+                uintptr_t addr  = readAddr( &at, end, &last );
+
+                // NULL and CK_TEMP go as they are; an owner
+                // we've expired can't take the block, so it
+                // gets a cycle to be ref'd like a temporary
+                unsigned oid = findObj( owner );
+                void*    own = (void*)owner;
+                if( owner > (uintptr_t)CK_TEMP )
+                {
+                    if( oid == NO_OBJ || objs[oid].dead )
+                    {
+                        own = CK_TEMP;
+                        oid = NO_OBJ;
+                        missed++;
+                    }
+                    else
+                        own = objs[oid].ptr;
+                }
+
+                unsigned id = makeObj( bytes, tag, own, oid, op == CK_OP_ALLOC_FAT );
+                if( id != NO_OBJ )
+                    mapObj( addr, id );
+                break;
+            }
+            case CK_OP_REF:
+            {
+                unsigned  id    = findObj( readAddr( &at, end, &last ) );
+                uintptr_t oAddr = readAddr( &at, end, &last );
+                unsigned  owner = findObj( oAddr );
+                if( id == NO_OBJ || objs[id].dead )
+                {
+                    missed++;
+                    break;
+                }
+                if( oAddr == 0 )
+                {
+                    ck_ref( pool, objs[id].ptr, NULL );
+                    break;
+                }
+                if( owner == NO_OBJ || objs[owner].dead )
+                {
+                    missed++;
+                    break;
+                }
+                addKid( owner, id );
+                if( !inBatch( owner ) )
+                    refObj( id, owner );
+                break;
+            }
+            case CK_OP_MOVE:
+            {
+                unsigned  id   = findObj( readAddr( &at, end, &last ) );
+                uintptr_t addr = readAddr( &at, end, &last );
+                if( id != NO_OBJ )
+                    mapObj( addr, id );
+                break;
+            }
+            case CK_OP_UNROOT:
+            {
+                unsigned id    = findObj( readAddr( &at, end, &last ) );
+                unsigned owner = findObj( readAddr( &at, end, &last ) );
+                if( id == NO_OBJ || objs[id].dead )
+                {
+                    missed++;
+                    break;
+                }
+                if( owner != NO_OBJ && !objs[owner].dead )
+                    addKid( owner, id );
+                ck_unroot( pool, objs[id].ptr,
+                           owner != NO_OBJ && !objs[owner].dead ? objs[owner].ptr : NULL );
+                break;
+            }
+            case CK_OP_PUSH_ROOT:
+            {
+                unsigned id = findObj( readAddr( &at, end, &last ) );
+                if( id == NO_OBJ || objs[id].dead )
+                {
+                    missed++;
+                    break;
+                }
+                ck_pushRoot( pool, objs[id].ptr );
+                break;
+            }
+            case CK_OP_POP_ROOT:
+                ck_popRoot( pool );
+                break;
+            case CK_OP_SCOPE_RELEASE:
+                ck_scopeRelease( pool, readNum( &at, end ) );
+                break;
+            case CK_OP_CYCLE:
+                ck_cycle( pool );
+                break;
+            case CK_OP_TICK:
+                ck_tick( pool );
+                break;
+            case CK_OP_STEP:
+                ck_step( pool );
+                break;
+            case CK_OP_ADVANCE:
+                ck_advance( pool, readNum( &at, end ) );
+                break;
+            case CK_OP_RESERVE:
+            {
+                size_t   amount = readNum( &at, end );
+                unsigned tag    = readNum( &at, end );
+                ck_reserveTagged( pool, amount, tag );
+                break;
+            }
+            case CK_OP_PRESERVE:
+            {
+                // the refs that follow are the object's whole
+                // set of kids from now on
+                unsigned id = findObj( readAddr( &at, end, &last ) );
+                if( prev != CK_OP_PRESERVE )
+                    nBatch = 0;
+                if( id == NO_OBJ )
+                    break;
+                objs[id].nKids = 0;
+                if( nBatch == capBatch )
+                {
+                    capBatch = capBatch ? capBatch * 2 : 64;
+                    batch    = realloc( batch, capBatch * sizeof(*batch) );
+                }
+                batch[nBatch++] = id;
+                break;
+            }
+            case CK_OP_FREEZE:
+            case CK_OP_THAW:
+            {
+                // the freeze walks the set with our own preserve
+                // callback, the recorded walk just updates kids
+                unsigned id = findObj( readAddr( &at, end, &last ) );
+                if( id == NO_OBJ || objs[id].dead )
+                {
+                    missed++;
+                    break;
+                }
+                if( op == CK_OP_FREEZE )
+                    ck_freeze( pool, objs[id].ptr );
+                else
+                    ck_thaw( pool, objs[id].ptr );
+                break;
+            }
+            case CK_OP_COLLECT_ALL:
+                // traced with our own preserve callback too
+                ck_collectAll( pool );
+                break;
+        }
+        prev = op;
+
+        if( flags & CK_DEFER_FINALIZE )
+            ck_runFinalizers( pool, SIZE_MAX );
+        if( ck_used( pool ) > maxUsed )
+            maxUsed = ck_used( pool );
+    }
+    double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+    printf( "replayed %lu allocs, %lu refs, %lu unroots, %lu ticks, "
+            "%lu cycles, %lu steps\n",
+            opCounts[CK_OP_ALLOC_SLIM] + opCounts[CK_OP_ALLOC_FAT],
+            opCounts[CK_OP_REF], opCounts[CK_OP_UNROOT],
+            opCounts[CK_OP_TICK] + opCounts[CK_OP_ADVANCE],
+            opCounts[CK_OP_CYCLE], opCounts[CK_OP_STEP] );
+    printf( "recorded preservations %lu, replayed %lu\n",
+            opCounts[CK_OP_PRESERVE], preserves );
+    printf( "expired %lu of %u, refs to expired objects %lu\n",
+            expired, nObjs - 1, missed );
+    printf( "max used %zu bytes, %.3f seconds\n", maxUsed, secs );
+
+    freeAll();
+    free( trace );
+    return 0;
+}
+
+void* rAlloc( void* context, void* old, size_t size )
+{
+    if( size == 0 )
+    {
+        free( old );
+        return NULL;
+    }
+    return realloc( old, size );
+}
+
+void rExpire( void* context, void* alloc )
+{
+    if( freeing )
+        return;
+    objs[*(unsigned*)alloc].dead = true;
+    expired++;
+}
+
+void rPreserve( void* context, void* alloc, ck_Pool* pool )
+{
+    Obj* obj = &objs[*(unsigned*)alloc];
+    preserves++;
+
+    // kids that have expired were dropped by the recorded
+    // program too, or it would have ref'd them
+    for( unsigned i = 0 ; i < obj->nKids ; )
+    {
+        unsigned kid = obj->kids[i];
+        if( objs[kid].dead )
+        {
+            obj->kids[i] = obj->kids[--obj->nKids];
+            continue;
+        }
+        refObj( kid, obj - objs );
+        i++;
+    }
+}
+
+void refObj( unsigned id, unsigned owner )
+{
+    if( !moving )
+        ck_ref( pool, objs[id].ptr, objs[owner].ptr );
+    else
+        objs[id].ptr = ck_refMove( pool, objs[id].ptr, objs[owner].ptr );
+}
+
+void addKid( unsigned owner, unsigned kid )
+{
+    Obj* obj = &objs[owner];
+    for( unsigned i = 0 ; i < obj->nKids ; i++ )
+    {
+        if( obj->kids[i] == kid )
+            return;
+    }
+    if( obj->nKids == obj->capKids )
+    {
+        obj->capKids = obj->capKids ? obj->capKids * 2 : 4;
+        obj->kids    = realloc( obj->kids, obj->capKids * sizeof(*obj->kids) );
+    }
+    obj->kids[obj->nKids++] = kid;
+}
+
+unsigned makeObj( size_t size, unsigned tag, void* own, unsigned owner, bool fat )
+{
+    if( nObjs >= capObjs )
+    {
+        capObjs = capObjs ? capObjs * 2 : 1024;
+        objs    = realloc( objs, capObjs * sizeof(*objs) );
+    }
+
+    // every block has room for its id
+    if( size < sizeof(unsigned) )
+        size = sizeof(unsigned);
+    void* ptr = fat ? ck_allocFatTagged( pool, size, own, tag )
+                    : ck_allocSlimTagged( pool, size, own, tag );
+    if( ptr == NULL )
+        return NO_OBJ;
+
+    unsigned id = nObjs++;
+    objs[id] = (Obj){ .ptr = ptr };
+    *(unsigned*)ptr = id;
+    if( owner != NO_OBJ )
+        addKid( owner, id );
+    return id;
+}
+
+unsigned findObj( uintptr_t addr )
+{
+    if( addr <= (uintptr_t)CK_TEMP || capSlots == 0 )
+        return NO_OBJ;
+    for( size_t i = (addr >> 4) * 0x9E3779B97F4A7C15u % capSlots ;
+         slots[i].addr != 0 ;
+         i = (i + 1) % capSlots )
+    {
+        if( slots[i].addr == addr )
+            return slots[i].id;
+    }
+    return NO_OBJ;
+}
+
+void mapObj( uintptr_t addr, unsigned id )
+{
+    if( (nSlots + 1) * 2 > capSlots )
+    {
+        Slot*  old    = slots;
+        size_t oldCap = capSlots;
+        capSlots = capSlots ? capSlots * 2 : 4096;
+        slots    = calloc( capSlots, sizeof(*slots) );
+        nSlots   = 0;
+        for( size_t i = 0 ; i < oldCap ; i++ )
+        {
+            if( old[i].addr != 0 )
+                mapObj( old[i].addr, old[i].id );
+        }
+        free( old );
+    }
+
+    // an address that's been freed and handed out again
+    // now names the new block
+    size_t i = (addr >> 4) * 0x9E3779B97F4A7C15u % capSlots;
+    while( slots[i].addr != 0 && slots[i].addr != addr )
+        i = (i + 1) % capSlots;
+    if( slots[i].addr == 0 )
+        nSlots++;
+    slots[i].addr = addr;
+    slots[i].id   = id;
+}
+
+bool inBatch( unsigned id )
+{
+    for( unsigned i = 0 ; i < nBatch ; i++ )
+    {
+        if( batch[i] == id )
+            return true;
+    }
+    return false;
+}
+
+uint64_t readNum( uint8_t const** at, uint8_t const* end )
+{
+    uint64_t num   = 0;
+    unsigned shift = 0;
+    while( *at < end )
+    {
+        uint8_t byte = *(*at)++;
+        num |= (uint64_t)(byte & 0x7f) << shift;
+        if( !(byte & 0x80) )
+            break;
+        shift += 7;
+    }
+    return num;
+}
+
+uintptr_t readAddr( uint8_t const** at, uint8_t const* end, uintptr_t* last )
+{
+    // see ck_TraceOp for the coding
+    uint64_t code = readNum( at, end );
+    if( code < 2 )
+        return code;
+    code -= 2;
+    int64_t diff = (int64_t)(code >> 1) ^ -(int64_t)(code & 1);
+    *last += diff;
+    return *last;
+}
+
+void freeAll( void )
+{
+    // the pool goes first, with 'freeing' set so that its
+    // last expirations aren't counted; id zero is never used
+    freeing = true;
+    ck_freePool( pool );
+    for( unsigned i = 1 ; i < nObjs ; i++ )
+        free( objs[i].kids );
+    free( objs );
+    free( slots );
+    free( batch );
+}
@@ -0,0 +1,1469 @@
+// fileno, fork and the like are POSIX, which a strict -std=
+// hides without this
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include "clok.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+// randomized stress test for the collector; mutates an object
+// graph through the public API while keeping a shadow copy of
+// the graph, which is traced after every mutation so we know
+// exactly when each block becomes unreachable.  any block that
+// expires while still reachable is reported as premature, and
+// for everything else we measure how many ticks the garbage
+// lingered before it was expired, or has so far if it's still
+// around at the end; garbage that's been around for far too
+// long by then is reported as stuck.  with -k it runs a set of
+// small deterministic checks of the pool's features instead
+//
+// usage: stress [-s seed] [-n ops] [-l live] [-q quota] [-r] [-d] [-c] [-b] [-a]
+//               [-t trace] [-k]
+//     -r  use the region heap
+//     -d  use deferred finalization
+//     -c  use compaction, refs go through ck_refMove
+//     -b  put slim blocks in slabs
+//     -a  use adaptive preservation periods
+//     -t  record the run to 'trace' for the replay tool
+//     -k  run the feature checks, with any of the flags above
+//         but -c
+
+#define MAX_KIDS (8)
+
+// ids start at one so zero can mean 'no block'
+#define NO_ID    (0)
+#define ROOT_ID  (1)
+
+// ids handed out by the checks, which only make a few blocks
+#define MAX_CHECK_IDS (4096)
+
+// ticks in a cycle, one for each slot in the pool's schedule
+#define CYCLE_TICKS   (255)
+
+// garbage that's still around this many cycles after it was
+// dropped has been missed; with CK_ADAPTIVE each step down a
+// dropped structure can take one of the longest preservation
+// periods, so it's that many periods instead
+#define STUCK_CYCLES   (32)
+#define LONGEST_PERIOD (32)
+
+// a failed check is reported and counted, and the rest still run
+#define CHECK( cond ) \
+    ((cond) ? (void)0 : (void)(failed++, printf( "%s:%d: check failed: %s\n", \
+                                                 __FILE__, __LINE__, #cond )))
+
+typedef struct Obj    Obj;
+typedef struct Record Record;
+
+// the block contents; slim blocks only have the id
+struct Obj
+{
+    unsigned id;
+    unsigned nKids;
+    void*    kids[MAX_KIDS];
+};
+
+// shadow state for each block ever allocated, indexed by id
+struct Record
+{
+    void*    ptr;
+    size_t   size;
+    bool     fat;
+    bool     root;
+    bool     reachable;
+    bool     dead;
+    unsigned kids[MAX_KIDS];
+    unsigned long lostAt;
+};
+
+static ck_Pool*      pool;
+static Record*       recs;
+static unsigned      nRecs;
+static unsigned      capRecs;
+static unsigned*     live;
+static unsigned      nLive;
+static unsigned*     queue;
+static unsigned long ticks;
+
+static unsigned long* lats;
+static size_t         nLats;
+static size_t         capLats;
+
+static bool          freeing;
+static bool          moving;
+static unsigned long premature;
+static unsigned long stuck;
+static unsigned long expired;
+static size_t        liveBytes;
+static size_t        floatBytes;
+static size_t        maxLive;
+static size_t        maxFloat;
+static double        sumFloat;
+
+static unsigned      checkFlags;
+static unsigned      nextId;
+static bool          gone[MAX_CHECK_IDS];
+static unsigned long failed;
+static unsigned      restored;
+static Obj*          readChain;
+static atomic_uint   readStage;
+static bool          readBroken;
+static uint64_t      fakeNow;
+static unsigned long preserves;
+
+void* sAlloc( void* context, void* old, size_t size );
+void  sExpire( void* context, void* alloc );
+void  sPreserve( void* context, void* alloc, ck_Pool* pool );
+void  trace( void );
+void  detach( unsigned id );
+void  setKid( unsigned owner, unsigned slot, unsigned kid );
+void* refKid( void* alloc, void* owner );
+unsigned makeObj( unsigned owner, bool fat );
+unsigned pickLive( bool fat );
+unsigned rnd( unsigned n );
+void  addLat( unsigned long lat );
+int   cmpLat( void const* a, void const* b );
+void  report( unsigned flags );
+
+int      checks( unsigned flags );
+ck_Config cConfig( unsigned flags );
+ck_Pool* cPool( unsigned flags );
+void*    cObj( ck_Pool* pool, void* owner, bool fat );
+unsigned cId( void* alloc );
+void     cSettle( ck_Pool* pool, unsigned cycles );
+void     cExpire( void* context, void* alloc );
+void     cPreserve( void* context, void* alloc, ck_Pool* pool );
+void     cRestore( void* context, void* alloc, ptrdiff_t delta );
+void*    cReader( void* pool );
+void     cHold( ck_Pool* pool, bool kept );
+uint64_t cNow( void* context );
+void     checkBasics( void );
+void     checkCycle( void );
+void     checkWeak( void );
+void     checkResident( void );
+void     checkImage( void );
+void     checkTags( void );
+void     checkTry( void );
+void     checkReaders( void );
+void     checkScope( void );
+void     checkGroup( void );
+void     checkStacks( void );
+void     checkIntern( void );
+void     checkRemote( void );
+void     checkGuard( void );
+void     checkTTL( void );
+void     checkIdle( void );
+void     checkFreeze( void );
+void     checkCollectAll( void );
+void     checkFallback( void );
+
+int main( int argc, char** argv )
+{
+    unsigned long seed   = 1;
+    unsigned long ops    = 200000;
+    unsigned      target = 2000;
+    size_t        quota  = SIZE_MAX;
+    unsigned      flags  = 0;
+    char const*   path   = NULL;
+    bool          check  = false;
+
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        if( !strcmp( argv[i], "-s" ) && i + 1 < argc )
+            seed = strtoul( argv[++i], NULL, 0 );
+        else
+        if( !strcmp( argv[i], "-n" ) && i + 1 < argc )
+            ops = strtoul( argv[++i], NULL, 0 );
+        else
+        if( !strcmp( argv[i], "-l" ) && i + 1 < argc )
+            target = strtoul( argv[++i], NULL, 0 );
+        else
+        if( !strcmp( argv[i], "-q" ) && i + 1 < argc )
+            quota = strtoull( argv[++i], NULL, 0 );
+        else
+        if( !strcmp( argv[i], "-r" ) )
+            flags |= CK_REGION_HEAP;
+        else
+        if( !strcmp( argv[i], "-d" ) )
+            flags |= CK_DEFER_FINALIZE;
+        else
+        if( !strcmp( argv[i], "-c" ) )
+        {
+            flags |= CK_COMPACT;
+            moving = true;
+        }
+        else
+        if( !strcmp( argv[i], "-b" ) )
+            flags |= CK_SLAB_SLIM;
+        else
+        if( !strcmp( argv[i], "-a" ) )
+            flags |= CK_ADAPTIVE;
+        else
+        if( !strcmp( argv[i], "-t" ) && i + 1 < argc )
+            path = argv[++i];
+        else
+        if( !strcmp( argv[i], "-k" ) )
+            check = true;
+        else
+        {
+            fprintf( stderr, "usage: %s [-s seed] [-n ops] [-l live] "
+                             "[-q quota] [-r] [-d] [-c] [-b] [-a] "
+                             "[-t trace] [-k]\n", argv[0] );
+            return 2;
+        }
+    }
+    if( check )
+        return checks( flags );
+    srand( seed );
+
+    ck_Config config = { .quota    = quota,
+                         .alloc    = &sAlloc,
+                         .expire   = &sExpire,
+                         .preserve = &sPreserve,
+                         .context  = NULL,
+                         .flags    = flags };
+    pool = ck_makePool( &config );
+
+    FILE* out = path ? fopen( path, "wb" ) : NULL;
+    if( path && (out == NULL || ck_record( pool, fileno( out ) )) )
+    {
+        perror( path );
+        return 1;
+    }
+
+    // the main root, never unrooted
+    nRecs = ROOT_ID;
+    makeObj( NO_ID, true );
+    trace();
+
+    for( unsigned long op = 0 ; op < ops ; op++ )
+    {
+        unsigned choice = rnd( 100 );
+        bool     grow   = nLive < target;
+
+        if( choice < (grow ? 45 : 25) )
+        {
+            // allocate, mostly owned by some live fat block
+            // but occasionally as a new root
+            unsigned owner = rnd( 100 ) < 3 ? NO_ID : pickLive( true );
+            unsigned id    = makeObj( owner, rnd( 2 ) );
+            if( owner )
+                setKid( owner, rnd( MAX_KIDS ), id );
+        }
+        else
+        if( choice < 60 )
+        {
+            unsigned owner = pickLive( true );
+            unsigned kid   = pickLive( false );
+            setKid( owner, rnd( MAX_KIDS ), kid );
+        }
+        else
+        if( choice < (grow ? 75 : 85) )
+        {
+            unsigned owner = pickLive( true );
+            setKid( owner, rnd( MAX_KIDS ), NO_ID );
+        }
+        else
+        if( choice < 88 )
+        {
+            // unroot one of the extra roots, handing it to an
+            // owner that gets the only reference to it
+            unsigned id = pickLive( false );
+            if( id != ROOT_ID && recs[id].root )
+            {
+                unsigned owner = pickLive( true );
+                if( owner != id )
+                {
+                    setKid( owner, rnd( MAX_KIDS ), id );
+                    ck_unroot( pool, recs[id].ptr, recs[owner].ptr );
+                    recs[id].root = false;
+                }
+            }
+        }
+        else
+        {
+            ck_tick( pool );
+            if( flags & CK_DEFER_FINALIZE )
+                ck_runFinalizers( pool, SIZE_MAX );
+            ticks++;
+
+            sumFloat += floatBytes;
+            if( floatBytes > maxFloat )
+                maxFloat = floatBytes;
+            if( liveBytes > maxLive )
+                maxLive = liveBytes;
+        }
+
+        trace();
+    }
+
+    report( flags );
+    freeing = true;
+    ck_freePool( pool );
+    if( out )
+        fclose( out );
+    return premature || stuck ? 1 : 0;
+}
+
+void* sAlloc( void* context, void* old, size_t size )
+{
+    if( size == 0 )
+    {
+        free( old );
+        return NULL;
+    }
+    return realloc( old, size );
+}
+
+void sExpire( void* context, void* alloc )
+{
+    unsigned id  = ((Obj*)alloc)->id;
+    Record*  rec = &recs[id];
+
+    if( rec->dead || freeing )
+        return;
+
+    expired++;
+    if( rec->reachable )
+    {
+        premature++;
+        printf( "PREMATURE: block %u (%s%s) expired at tick %lu "
+                "while reachable\n",
+                id, rec->fat ? "fat" : "slim", rec->root ? ", root" : "",
+                ticks );
+
+        // cut it out of the graph so we don't touch it again
+        detach( id );
+        liveBytes -= rec->size;
+    }
+    else
+    {
+        addLat( ticks - rec->lostAt );
+        floatBytes -= rec->size;
+    }
+    rec->dead = true;
+    rec->ptr  = NULL;
+}
+
+void sPreserve( void* context, void* alloc, ck_Pool* pool )
+{
+    Obj* obj = alloc;
+    for( unsigned i = 0 ; i < MAX_KIDS ; i++ )
+        obj->kids[i] = refKid( obj->kids[i], obj );
+}
+
+void trace( void )
+{
+    // mark everything reachable from the roots over
+    // the shadow edges, and note when blocks are lost
+    for( unsigned i = 0 ; i < nLive ; i++ )
+        recs[live[i]].reachable = false;
+
+    unsigned head = 0, tail = 0;
+    for( unsigned i = 0 ; i < nLive ; i++ )
+    {
+        Record* rec = &recs[live[i]];
+        if( rec->root )
+        {
+            rec->reachable = true;
+            queue[tail++]  = live[i];
+        }
+    }
+    while( head < tail )
+    {
+        Record* rec = &recs[queue[head++]];
+        if( !rec->fat )
+            continue;
+        for( unsigned i = 0 ; i < MAX_KIDS ; i++ )
+        {
+            Record* kid = &recs[rec->kids[i]];
+            if( rec->kids[i] && !kid->reachable )
+            {
+                kid->reachable = true;
+                queue[tail++]  = rec->kids[i];
+            }
+        }
+    }
+
+    unsigned kept = 0;
+    for( unsigned i = 0 ; i < nLive ; i++ )
+    {
+        Record* rec = &recs[live[i]];
+        if( rec->reachable )
+        {
+            live[kept++] = live[i];
+        }
+        else
+        if( !rec->dead )
+        {
+            rec->lostAt = ticks;
+            liveBytes  -= rec->size;
+            floatBytes += rec->size;
+        }
+    }
+    nLive = kept;
+}
+
+void detach( unsigned id )
+{
+    for( unsigned i = 0 ; i < nLive ; i++ )
+    {
+        Record* rec = &recs[live[i]];
+        if( !rec->fat || rec->dead )
+            continue;
+        for( unsigned j = 0 ; j < MAX_KIDS ; j++ )
+        {
+            if( rec->kids[j] == id )
+                setKid( live[i], j, NO_ID );
+        }
+    }
+    recs[id].root      = false;
+    recs[id].reachable = false;
+}
+
+void setKid( unsigned owner, unsigned slot, unsigned kid )
+{
+    Obj* obj = recs[owner].ptr;
+    recs[owner].kids[slot] = kid;
+    obj->kids[slot] = refKid( kid ? recs[kid].ptr : NULL, obj );
+}
+
+void* refKid( void* alloc, void* owner )
+{
+    if( !moving )
+    {
+        ck_ref( pool, alloc, owner );
+        return alloc;
+    }
+    
+    // the shadow copy follows the block wherever it goes
+    alloc = ck_refMove( pool, alloc, owner );
+    if( alloc )
+        recs[((Obj*)alloc)->id].ptr = alloc;
+    return alloc;
+}
+
+unsigned makeObj( unsigned owner, bool fat )
+{
+    if( nRecs >= capRecs )
+    {
+        capRecs = capRecs ? capRecs * 2 : 1024;
+        recs    = realloc( recs, capRecs * sizeof(*recs) );
+        memset( recs + nRecs, 0, (capRecs - nRecs) * sizeof(*recs) );
+        live    = realloc( live, capRecs * sizeof(*live) );
+        queue   = realloc( queue, capRecs * sizeof(*queue) );
+    }
+
+    unsigned id   = nRecs++;
+    size_t   size = fat ? sizeof(Obj) + rnd( 256 )
+                        : sizeof(unsigned) + rnd( 600 );
+    void*    own  = owner ? recs[owner].ptr : NULL;
+    void*    ptr  = fat ? ck_allocFat( pool, size, own )
+                        : ck_allocSlim( pool, size, own );
+
+    Record* rec = &recs[id];
+    memset( rec, 0, sizeof(*rec) );
+    rec->size = size;
+    rec->fat  = fat;
+    rec->root = (own == NULL);
+
+    if( ptr == NULL )
+    {
+        // over quota, record it as dead on arrival
+        rec->dead = true;
+        return NO_ID;
+    }
+
+    memset( ptr, 0, fat ? sizeof(Obj) : sizeof(unsigned) );
+    ((Obj*)ptr)->id = id;
+    rec->ptr        = ptr;
+    rec->reachable  = true;
+    live[nLive++]   = id;
+    liveBytes      += size;
+    return id;
+}
+
+unsigned pickLive( bool fat )
+{
+    // falls back on the main root, which is always live
+    for( unsigned tries = 0 ; tries < 16 ; tries++ )
+    {
+        unsigned id = live[rnd( nLive )];
+        if( !fat || recs[id].fat )
+            return id;
+    }
+    return ROOT_ID;
+}
+
+unsigned rnd( unsigned n )
+{
+    return n ? (unsigned)rand() % n : 0;
+}
+
+void addLat( unsigned long lat )
+{
+    if( nLats == capLats )
+    {
+        capLats = capLats ? capLats * 2 : 1024;
+        lats    = realloc( lats, capLats * sizeof(*lats) );
+    }
+    lats[nLats++] = lat;
+}
+
+int cmpLat( void const* a, void const* b )
+{
+    unsigned long x = *(unsigned long const*)a;
+    unsigned long y = *(unsigned long const*)b;
+    return (x > y) - (x < y);
+}
+
+void report( unsigned flags )
+{
+    // garbage that's still waiting counts with the ticks it's
+    // waited so far, or a collector that never got to it would
+    // look better than one that did
+    unsigned long limit    = STUCK_CYCLES * CYCLE_TICKS;
+    size_t        floating = 0;
+    unsigned long oldest   = 0;
+    if( flags & CK_ADAPTIVE )
+        limit *= LONGEST_PERIOD;
+    for( unsigned id = ROOT_ID ; id < nRecs ; id++ )
+    {
+        if( !recs[id].dead && !recs[id].reachable )
+        {
+            floating++;
+            unsigned long age = ticks - recs[id].lostAt;
+            if( age > oldest )
+                oldest = age;
+            addLat( age );
+            if( age > limit )
+                stuck++;
+        }
+    }
+
+    printf( "ops: %lu ticks, %u blocks allocated, %lu expired\n",
+            ticks, nRecs, expired );
+    printf( "premature expirations: %lu\n", premature );
+    printf( "live at end: %u, unreachable but not yet expired: %zu\n",
+            nLive, floating );
+    printf( "oldest garbage: %lu ticks, stuck for over %lu ticks: %lu\n",
+            oldest, limit, stuck );
+
+    if( nLats )
+    {
+        qsort( lats, nLats, sizeof(*lats), &cmpLat );
+        double sum = 0;
+        for( size_t i = 0 ; i < nLats ; i++ )
+            sum += lats[i];
+
+        printf( "reclaim latency (ticks from unreachable to expired):\n" );
+        printf( "    mean %.1f  p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu\n",
+                sum / nLats,
+                lats[nLats / 2],
+                lats[nLats * 9 / 10],
+                lats[nLats * 99 / 100],
+                lats[nLats * 999 / 1000],
+                lats[nLats - 1] );
+
+        // coarse histogram in units of cycles
+        size_t buckets[6] = { 0 };
+        for( size_t i = 0 ; i < nLats ; i++ )
+        {
+            unsigned long c = lats[i] / 255;
+            buckets[c < 5 ? c : 5]++;
+        }
+        printf( "    by cycle:" );
+        for( unsigned i = 0 ; i < 6 ; i++ )
+            printf( "  %s%uc %.1f%%", i == 5 ? ">=" : "<", i == 5 ? 5 : i + 1,
+                    100.0 * buckets[i] / nLats );
+        printf( "\n" );
+    }
+
+    if( ticks && maxLive )
+    {
+        printf( "floating garbage: mean %.0f bytes, max %zu bytes\n",
+                sumFloat / ticks, maxFloat );
+        printf( "max live %zu bytes; quota headroom needed ~%.0f%%\n",
+                maxLive, 100.0 * maxFloat / maxLive );
+    }
+}
+
+// feature checks; each one makes its own pool, where fat
+// blocks are Objs whose kids are refed by cPreserve and every
+// block starts with an id that cExpire marks as gone.  a pool
+// whose context is another pool holds its kids there
+int checks( unsigned flags )
+{
+    // the checks hold on to block pointers, so nothing may move
+    checkFlags = flags & ~CK_COMPACT;
+    
+    checkBasics();
+    checkCycle();
+    checkWeak();
+    checkResident();
+    checkImage();
+    checkTags();
+    checkTry();
+    checkReaders();
+    checkScope();
+    checkGroup();
+    checkStacks();
+    checkIntern();
+    checkRemote();
+    checkGuard();
+    checkTTL();
+    checkIdle();
+    checkFreeze();
+    checkCollectAll();
+    checkFallback();
+    
+    printf( "failed checks: %lu\n", failed );
+    return failed ? 1 : 0;
+}
+
+ck_Config cConfig( unsigned flags )
+{
+    ck_Config config = { .quota    = SIZE_MAX,
+                         .alloc    = &sAlloc,
+                         .expire   = &cExpire,
+                         .preserve = &cPreserve,
+                         .context  = NULL,
+                         .flags    = checkFlags | flags,
+                         .restore  = &cRestore };
+    return config;
+}
+
+ck_Pool* cPool( unsigned flags )
+{
+    ck_Config config = cConfig( flags );
+    memset( gone, 0, sizeof(gone) );
+    nextId = 1;
+    return ck_makePool( &config );
+}
+
+void* cObj( ck_Pool* pool, void* owner, bool fat )
+{
+    // slim ones are whole Objs too, with no kids, so that
+    // cRestore can go through any block
+    void* ptr = fat ? ck_allocFat( pool, sizeof(Obj), owner )
+                    : ck_allocSlim( pool, sizeof(Obj), owner );
+    if( ptr == NULL )
+        return NULL;
+    memset( ptr, 0, sizeof(Obj) );
+    ((Obj*)ptr)->id = nextId++;
+    return ptr;
+}
+
+unsigned cId( void* alloc )
+{
+    return ((Obj*)alloc)->id;
+}
+
+void cSettle( ck_Pool* pool, unsigned cycles )
+{
+    for( unsigned i = 0 ; i < cycles ; i++ )
+    {
+        ck_cycle( pool );
+        if( checkFlags & CK_DEFER_FINALIZE )
+            ck_runFinalizers( pool, SIZE_MAX );
+    }
+}
+
+void cExpire( void* context, void* alloc )
+{
+    unsigned id = cId( alloc );
+    if( id < MAX_CHECK_IDS )
+        gone[id] = true;
+}
+
+void cPreserve( void* context, void* alloc, ck_Pool* pool )
+{
+    Obj* obj = alloc;
+    preserves++;
+    for( unsigned i = 0 ; i < obj->nKids ; i++ )
+    {
+        if( obj->kids[i] && context )
+            ck_refRemote( context, obj->kids[i], pool, obj );
+        else
+        if( obj->kids[i] )
+            ck_ref( pool, obj->kids[i], obj );
+    }
+}
+
+void cRestore( void* context, void* alloc, ptrdiff_t delta )
+{
+    Obj* obj = alloc;
+    for( unsigned i = 0 ; i < obj->nKids ; i++ )
+    {
+        if( obj->kids[i] )
+            obj->kids[i] = (char*)obj->kids[i] + delta;
+    }
+    restored++;
+}
+
+void* cReader( void* pool )
+{
+    // gets into a read section while the chain's still live,
+    // then waits for the pool to drop and collect it before
+    // walking it; its ids run up by one from the head, so a
+    // node that was freed and reused breaks the chain
+    unsigned ticket = ck_readEnter( pool );
+    Obj*     head   = readChain;
+    atomic_store( &readStage, 1 );
+    while( atomic_load( &readStage ) != 2 )
+        sched_yield();
+    
+    unsigned length = 0;
+    for( Obj* obj = head ; obj ; obj = obj->nKids ? obj->kids[0] : NULL )
+    {
+        readBroken |= obj->id != head->id + length;
+        length++;
+    }
+    readBroken |= length != MAX_KIDS;
+    ck_readExit( pool, ticket );
+    return NULL;
+}
+
+void cHold( ck_Pool* pool, bool kept )
+{
+    // holds a block in nothing but a local for a few cycles,
+    // a frame below the one that added the stack
+    void* volatile held = cObj( pool, CK_TEMP, false );
+    unsigned       id   = cId( held );
+    cSettle( pool, 3 );
+    CHECK( gone[id] != kept );
+}
+
+uint64_t cNow( void* context )
+{
+    return fakeNow;
+}
+
+void checkBasics( void )
+{
+    // a dropped kid goes within a few cycles, the kept one and
+    // the root stay however long it runs
+    ck_Pool* pool = cPool( 0 );
+    Obj*     root = cObj( pool, NULL, true );
+    void*    keep = cObj( pool, root, false );
+    void*    drop = cObj( pool, root, false );
+    unsigned dropId = cId( drop );
+    root->kids[0] = keep;
+    root->kids[1] = drop;
+    root->nKids   = 2;
+    cSettle( pool, 3 );
+    CHECK( !gone[dropId] );
+    
+    root->kids[1] = NULL;
+    cSettle( pool, 3 );
+    CHECK( gone[dropId] );
+    CHECK( !gone[cId( keep )] && !gone[cId( root )] );
+    ck_freePool( pool );
+}
+
+void checkCycle( void )
+{
+    // a dropped cycle is found by the owner chain walk and
+    // expires, while one the root still holds doesn't
+    ck_Pool* pool  = cPool( 0 );
+    Obj*     root  = cObj( pool, NULL, true );
+    Obj*     pairs[2][2];
+    unsigned ids[2][2];
+    for( unsigned i = 0 ; i < 2 ; i++ )
+    {
+        Obj* a = pairs[i][0] = cObj( pool, root, true );
+        Obj* b = pairs[i][1] = cObj( pool, root, true );
+        a->kids[a->nKids++] = b;
+        b->kids[b->nKids++] = a;
+        ck_ref( pool, b, a );
+        ck_ref( pool, a, b );
+        ids[i][0] = cId( a );
+        ids[i][1] = cId( b );
+        root->kids[root->nKids++] = a;
+    }
+    
+    // the countdown is a few preservations, which CK_ADAPTIVE
+    // spaces out by doubling
+    root->kids[1] = NULL;
+    cSettle( pool, checkFlags & CK_ADAPTIVE ? 40 : 12 );
+    CHECK( gone[ids[1][0]] && gone[ids[1][1]] );
+    CHECK( !gone[ids[0][0]] && !gone[ids[0][1]] && !gone[cId( root )] );
+    ck_freePool( pool );
+}
+
+void checkWeak( void )
+{
+    // handles follow their block until it expires, then read
+    // NULL, and can be freed either way
+    ck_Pool* pool   = cPool( 0 );
+    Obj*     root   = cObj( pool, NULL, true );
+    void*    keep   = cObj( pool, root, false );
+    void*    drop   = cObj( pool, root, true );
+    ck_Weak* toKeep = ck_makeWeak( pool, keep );
+    ck_Weak* toDrop = ck_makeWeak( pool, drop );
+    ck_Weak* again  = ck_makeWeak( pool, drop );
+    ck_Weak* early  = ck_makeWeak( pool, drop );
+    root->kids[0] = keep;
+    root->kids[1] = drop;
+    root->nKids   = 2;
+    cSettle( pool, 2 );
+    CHECK( ck_getWeak( pool, toKeep ) == keep );
+    CHECK( ck_getWeak( pool, toDrop ) == drop && ck_getWeak( pool, again ) == drop );
+    
+    ck_freeWeak( pool, early );
+    root->kids[1] = NULL;
+    cSettle( pool, 3 );
+    CHECK( ck_getWeak( pool, toKeep ) == keep );
+    CHECK( ck_getWeak( pool, toDrop ) == NULL && ck_getWeak( pool, again ) == NULL );
+    ck_freeWeak( pool, toDrop );
+    ck_freePool( pool );
+}
+
+void checkResident( void )
+{
+    // memory taken for a spike of short lived blocks goes back
+    // to the OS once they've been collected, not just to the pool
+    ck_Pool* pool = cPool( CK_REGION_HEAP );
+    Obj*     root = cObj( pool, NULL, true );
+    size_t   base = ck_resident( pool );
+    for( unsigned i = 0 ; i < 4096 ; i++ )
+        ck_allocSlim( pool, 256, root );
+    size_t   peak = ck_resident( pool );
+    CHECK( peak >= base + 4096 * 256 );
+    
+    cSettle( pool, 3 );
+    CHECK( ck_resident( pool ) < base + (peak - base) / 4 );
+    CHECK( !gone[cId( root )] );
+    ck_freePool( pool );
+}
+
+void checkImage( void )
+{
+    // an image loads back at its old address once that's
+    // free, and somewhere else while the pool that wrote it
+    // is still there, with the kids moved by cRestore
+    ck_Config config = cConfig( CK_REGION_HEAP );
+    ck_Pool*  pool   = cPool( CK_REGION_HEAP );
+    
+    Obj* root = cObj( pool, NULL, true );
+    Obj* kid  = cObj( pool, root, true );
+    Obj* leaf = cObj( pool, kid, false );
+    cObj( pool, root, false );
+    root->kids[0] = kid;
+    root->nKids   = 1;
+    kid->kids[0]  = leaf;
+    kid->nKids    = 1;
+    cSettle( pool, 2 );
+    
+    FILE* image = tmpfile();
+    CHECK( image != NULL && ck_savePool( pool, fileno( image ) ) == 0 );
+    if( image == NULL )
+    {
+        ck_freePool( pool );
+        return;
+    }
+    
+    for( unsigned pass = 0 ; pass < 2 ; pass++ )
+    {
+        // the first pass moves, the second goes back
+        if( pass == 1 )
+            ck_freePool( pool );
+        restored = 0;
+        ck_Pool* loaded = ck_loadPool( &config, fileno( image ) );
+        CHECK( loaded != NULL );
+        if( loaded == NULL )
+            continue;
+        
+        Obj*   roots[2];
+        size_t nRoots = ck_getRoots( loaded, (void**)roots, 2 );
+        CHECK( nRoots == 1 && (roots[0] == root) == (pass == 1) );
+        CHECK( restored == 3 );
+        if( nRoots == 1 )
+        {
+            Obj* r = roots[0];
+            CHECK( cId( r ) == cId( root ) && r->nKids == 1 );
+            CHECK( cId( r->kids[0] ) == cId( kid ) );
+            CHECK( cId( ((Obj*)r->kids[0])->kids[0] ) == cId( leaf ) );
+        }
+        ck_freePool( loaded );
+    }
+    fclose( image );
+}
+
+void checkTags( void )
+{
+    // a tag's blocks count against its own quota and nobody
+    // else's, and an allocation that can't fit fails even
+    // though the pool has room
+    ck_Pool* pool  = cPool( 0 );
+    Obj*     root  = cObj( pool, NULL, true );
+    Obj*     first = ck_allocSlimTagged( pool, sizeof(Obj), root, 3 );
+    size_t   quota = 4 * ck_tagUsed( pool, 3 );
+    ck_setTagQuota( pool, 3, quota );
+    CHECK( ck_allocSlimTagged( pool, sizeof(Obj), root, CK_MAX_TAGS ) == NULL );
+    memset( first, 0, sizeof(Obj) );
+    first->id = nextId++;
+    root->kids[root->nKids++] = first;
+    
+    size_t untagged = ck_tagUsed( pool, 0 );
+    while( root->nKids < MAX_KIDS )
+    {
+        Obj* kid = ck_allocSlimTagged( pool, sizeof(Obj), root, 3 );
+        if( kid == NULL )
+            break;
+        memset( kid, 0, sizeof(Obj) );
+        kid->id = nextId++;
+        root->kids[root->nKids++] = kid;
+    }
+    CHECK( root->nKids > 0 && root->nKids < MAX_KIDS );
+    CHECK( ck_tagUsed( pool, 3 ) > 0 && ck_tagUsed( pool, 3 ) <= quota );
+    CHECK( ck_tagUsed( pool, 0 ) == untagged );
+    CHECK( ck_tagUsed( pool, 0 ) + ck_tagUsed( pool, 3 ) == ck_used( pool ) );
+    CHECK( cObj( pool, root, false ) != NULL );
+    
+    // once they're dropped there's room again
+    root->nKids = 0;
+    cSettle( pool, 3 );
+    CHECK( ck_tagUsed( pool, 3 ) == 0 );
+    Obj* again = ck_allocSlimTagged( pool, sizeof(Obj), root, 3 );
+    CHECK( again != NULL );
+    if( again )
+        memset( again, 0, sizeof(Obj) );
+    ck_freePool( pool );
+}
+
+void checkTry( void )
+{
+    // the try allocators fail instead of collecting and say how
+    // far off they were, and nothing can help an allocation
+    // bigger than the whole quota
+    ck_Config config = cConfig( 0 );
+    config.quota     = 32 * sizeof(Obj);
+    ck_Pool*  pool   = ck_makePool( &config );
+    Obj*      root   = cObj( pool, NULL, true );
+    
+    ck_Shortfall status;
+    unsigned     garbage = 0;
+    for( ;; )
+    {
+        Obj* obj = ck_tryAllocSlim( pool, sizeof(Obj), root, &status );
+        if( obj == NULL )
+            break;
+        memset( obj, 0, sizeof(Obj) );
+        garbage++;
+    }
+    CHECK( garbage > 0 );
+    CHECK( status.bytes > 0 && status.bytes <= 2 * sizeof(Obj) );
+    CHECK( status.ticks > 0 && status.ticks <= CYCLE_TICKS );
+    CHECK( status.ticks == ck_forecast( pool, status.bytes ) );
+    
+    size_t used = ck_used( pool );
+    CHECK( ck_tryAllocFat( pool, sizeof(Obj), root, NULL ) == NULL );
+    CHECK( ck_used( pool ) == used );
+    
+    CHECK( ck_tryAllocFat( pool, config.quota + 1, root, &status ) == NULL );
+    CHECK( status.bytes > 0 && status.ticks == UINT_MAX );
+    
+    // the garbage was never refed, so once it's been collected
+    // there's room again
+    cSettle( pool, 3 );
+    CHECK( ck_used( pool ) < used );
+    CHECK( ck_tryAllocSlim( pool, sizeof(Obj), root, &status ) != NULL );
+    CHECK( status.bytes == 0 );
+    
+    // roots never expire, so once they've filled it up there's
+    // no cycle that can make room
+    cSettle( pool, 3 );
+    Obj* obj;
+    while( (obj = ck_tryAllocSlim( pool, sizeof(Obj), NULL, &status )) != NULL )
+        memset( obj, 0, sizeof(Obj) );
+    CHECK( status.bytes > 0 && status.ticks == UINT_MAX );
+    ck_freePool( pool );
+}
+
+void checkReaders( void )
+{
+    // a block that expires while another thread is reading it
+    // keeps its memory until the reader leaves, even with the
+    // pool allocating and collecting in the meantime
+    ck_Pool* pool = cPool( 0 );
+    Obj*     root = cObj( pool, NULL, true );
+    Obj*     chain[MAX_KIDS];
+    for( unsigned i = 0 ; i < MAX_KIDS ; i++ )
+        chain[i] = cObj( pool, i ? chain[i - 1] : root, true );
+    for( unsigned i = 0 ; i + 1 < MAX_KIDS ; i++ )
+    {
+        chain[i]->kids[0] = chain[i + 1];
+        chain[i]->nKids   = 1;
+    }
+    root->kids[0] = chain[0];
+    root->nKids   = 1;
+    
+    pthread_t reader;
+    readChain  = chain[0];
+    readBroken = false;
+    atomic_store( &readStage, 0 );
+    pthread_create( &reader, NULL, &cReader, pool );
+    while( atomic_load( &readStage ) != 1 )
+        sched_yield();
+    
+    // drop the chain and make some more blocks the same size,
+    // which would take its memory if it had been freed; with
+    // CK_ADAPTIVE the drop takes a little longer to get down it
+    unsigned first = cId( chain[0] );
+    root->nKids = 0;
+    cSettle( pool, checkFlags & CK_ADAPTIVE ? 8 : 3 );
+    CHECK( gone[first] && gone[first + MAX_KIDS - 1] );
+    for( unsigned i = 0 ; i < MAX_KIDS ; i++ )
+        cObj( pool, root, true );
+    
+    atomic_store( &readStage, 2 );
+    pthread_join( reader, NULL );
+    CHECK( !readBroken );
+    cSettle( pool, 1 );
+    CHECK( !gone[cId( root )] );
+    ck_freePool( pool );
+}
+
+void checkScope( void )
+{
+    // a temporary lasts as long as it's on the root stack, and
+    // goes within a few cycles of being popped, along with what
+    // it holds; one that was never stacked just goes
+    ck_Pool* pool  = cPool( 0 );
+    size_t   mark  = ck_scopeMark( pool );
+    Obj*     outer = cObj( pool, CK_TEMP, true );
+    void*    kid   = cObj( pool, outer, false );
+    void*    inner = cObj( pool, CK_TEMP, false );
+    unsigned loose = cId( cObj( pool, CK_TEMP, false ) );
+    unsigned ids[] = { cId( outer ), cId( kid ), cId( inner ) };
+    outer->kids[0] = kid;
+    outer->nKids   = 1;
+    CHECK( ck_pushRoot( pool, outer ) == outer );
+    CHECK( ck_pushRoot( pool, inner ) == inner );
+    CHECK( ck_scopeMark( pool ) == mark + 2 );
+    
+    cSettle( pool, 3 );
+    CHECK( !gone[ids[0]] && !gone[ids[1]] && !gone[ids[2]] );
+    CHECK( gone[loose] );
+    
+    ck_popRoot( pool );
+    cSettle( pool, 3 );
+    CHECK( !gone[ids[0]] && !gone[ids[1]] && gone[ids[2]] );
+    
+    ck_scopeRelease( pool, mark );
+    CHECK( ck_scopeMark( pool ) == mark );
+    cSettle( pool, 3 );
+    CHECK( gone[ids[0]] && gone[ids[1]] );
+    ck_freePool( pool );
+}
+
+void checkGroup( void )
+{
+    // a ref to any member keeps the whole group and what its
+    // first member holds, and the group expires as its first
+    size_t   sizes[3] = { sizeof(Obj), sizeof(Obj), sizeof(Obj) };
+    Obj*     member[3];
+    ck_Pool* pool = cPool( 0 );
+    Obj*     root = cObj( pool, NULL, true );
+    Obj*     head = ck_allocGroup( pool, sizes, 3, root, (void**)member );
+    CHECK( head != NULL && head == member[0] );
+    if( head == NULL )
+    {
+        ck_freePool( pool );
+        return;
+    }
+    
+    unsigned ids[3];
+    for( unsigned i = 0 ; i < 3 ; i++ )
+    {
+        memset( member[i], 0, sizeof(Obj) );
+        member[i]->id = ids[i] = nextId++;
+    }
+    Obj*     kid   = cObj( pool, head, false );
+    unsigned kidId = cId( kid );
+    head->kids[0] = kid;
+    head->nKids   = 1;
+    root->kids[0] = member[2];
+    root->nKids   = 1;
+    cSettle( pool, 3 );
+    CHECK( !gone[ids[0]] && !gone[kidId] );
+    CHECK( cId( member[1] ) == ids[1] && cId( member[2] ) == ids[2] );
+    
+    root->kids[0] = NULL;
+    cSettle( pool, 3 );
+    CHECK( gone[ids[0]] && gone[kidId] );
+    CHECK( !gone[ids[1]] && !gone[ids[2]] );
+    ck_freePool( pool );
+}
+
+void checkStacks( void )
+{
+    // a block held only by a local survives while the stack's
+    // scanned, and goes like any other once it's not
+    ck_Pool* pool = cPool( CK_SCAN_STACKS );
+    char     top;
+    CHECK( ck_addStack( pool, NULL, &top ) == 0 );
+    cHold( pool, true );
+    
+    ck_removeStack( pool, &top );
+    cHold( pool, false );
+    ck_freePool( pool );
+}
+
+void checkIntern( void )
+{
+    // equal bytes share a block however many others are in
+    // the table
+    enum { BLOBS = 1000, FIRST = 1000 };
+    static Obj* blobs[BLOBS];
+    ck_Pool* pool = cPool( 0 );
+    Obj*     root = cObj( pool, NULL, true );
+    Obj      data;
+    memset( &data, 0, sizeof(data) );
+    for( unsigned i = 0 ; i < BLOBS ; i++ )
+    {
+        data.id  = FIRST + i;
+        blobs[i] = ck_internSlim( pool, &data, sizeof(data), root );
+    }
+    unsigned same = 0;
+    for( unsigned i = 0 ; i < BLOBS ; i++ )
+    {
+        data.id = FIRST + i;
+        same   += ck_internSlim( pool, &data, sizeof(data), root ) == blobs[i];
+    }
+    CHECK( same == BLOBS );
+    CHECK( blobs[0] != blobs[1] && cId( blobs[1] ) == FIRST + 1 );
+    
+    // the ones that expire are forgotten, and the same bytes
+    // get a new block
+    root->kids[0] = blobs[0];
+    root->nKids   = 1;
+    cSettle( pool, 3 );
+    CHECK( !gone[FIRST] && gone[FIRST + 1] );
+    data.id = FIRST;
+    CHECK( ck_internSlim( pool, &data, sizeof(data), root ) == blobs[0] );
+    data.id = FIRST + 1;
+    Obj* fresh = ck_internSlim( pool, &data, sizeof(data), root );
+    CHECK( fresh != NULL && memcmp( fresh, &data, sizeof(data) ) == 0 );
+    CHECK( ck_internSlim( pool, &data, sizeof(data), root ) == fresh );
+    
+    // a blob that's only a prefix of another doesn't match it
+    data.id = FIRST;
+    CHECK( ck_internSlim( pool, &data, sizeof(unsigned), root ) != blobs[0] );
+    ck_freePool( pool );
+}
+
+void checkRemote( void )
+{
+    // a holder in one pool keeps blocks in another for as
+    // long as it refs them, with the two ticking together
+    ck_Pool*  there  = cPool( 0 );
+    ck_Config config = cConfig( 0 );
+    config.context   = there;
+    ck_Pool*  here   = ck_makePool( &config );
+    
+    Obj*     holder = cObj( here, NULL, true );
+    Obj*     keep   = cObj( there, CK_TEMP, true );
+    Obj*     drop   = cObj( there, CK_TEMP, false );
+    unsigned dropId = cId( drop );
+    CHECK( ck_refRemote( there, keep, here, CK_TEMP ) == -1 );
+    CHECK( ck_refRemote( there, keep, here, holder ) == 0 );
+    CHECK( ck_refRemote( there, drop, here, holder ) == 0 );
+    holder->kids[0] = keep;
+    holder->kids[1] = drop;
+    holder->nKids   = 2;
+    for( unsigned i = 0 ; i < 3 * CYCLE_TICKS ; i++ )
+    {
+        ck_tick( here );
+        ck_tick( there );
+    }
+    CHECK( !gone[cId( keep )] && !gone[dropId] );
+    
+    holder->kids[1] = NULL;
+    for( unsigned i = 0 ; i < 3 * CYCLE_TICKS ; i++ )
+    {
+        ck_tick( here );
+        ck_tick( there );
+        if( checkFlags & CK_DEFER_FINALIZE )
+            ck_runFinalizers( there, SIZE_MAX );
+    }
+    CHECK( !gone[cId( keep )] && gone[dropId] );
+    
+    // the holder's last refs are drained before it goes
+    ck_tick( there );
+    ck_freePool( here );
+    ck_freePool( there );
+}
+
+void checkGuard( void )
+{
+    // a use after expiry and an overrun each fault in a child
+    // whose stderr we read, and the report names the block
+    // and its owner
+    for( unsigned overrun = 0 ; overrun < 2 ; overrun++ )
+    {
+        ck_Pool* pool = cPool( 0 );
+        if( ck_guard( pool, 1 ) )
+        {
+            // region heap pools can't be sampled, and slabs
+            // put a pool on the region heap
+            CHECK( checkFlags & (CK_REGION_HEAP | CK_SLAB_SLIM) );
+            ck_freePool( pool );
+            return;
+        }
+        
+        int pipes[2];
+        CHECK( pipe( pipes ) == 0 );
+        fflush( stdout );
+        pid_t child = fork();
+        if( child == 0 )
+        {
+            dup2( pipes[1], STDERR_FILENO );
+            Obj*  root = cObj( pool, NULL, true );
+            char* kid  = cObj( pool, root, false );
+            fprintf( stderr, "%lx %lx\n", (unsigned long)(uintptr_t)kid,
+                                          (unsigned long)(uintptr_t)root );
+            fflush( stderr );
+            if( overrun )
+                kid[ck_blockSize( sizeof(Obj), 0 )] = 1;
+            cSettle( pool, 3 );
+            kid[0] = 1;
+            _exit( 0 );
+        }
+        close( pipes[1] );
+        
+        char    out[1024];
+        size_t  len = 0;
+        ssize_t got;
+        while( len < sizeof(out) - 1 &&
+               (got = read( pipes[0], out + len, sizeof(out) - 1 - len )) > 0 )
+            len += got;
+        out[len] = 0;
+        close( pipes[0] );
+        int status = 0;
+        waitpid( child, &status, 0 );
+        CHECK( WIFSIGNALED( status ) );
+        
+        unsigned long kid = 0, root = 0;
+        char          want[128];
+        CHECK( sscanf( out, "%lx %lx", &kid, &root ) == 2 );
+        if( overrun )
+            snprintf( want, sizeof(want), "allocated for owner 0x%lx\n", root );
+        else
+            snprintf( want, sizeof(want), "to expired slim block 0x%lx", kid );
+        CHECK( strstr( out, want ) != NULL );
+        if( !overrun )
+        {
+            snprintf( want, sizeof(want), "last owner 0x%lx\n", root );
+            CHECK( strstr( out, want ) != NULL );
+        }
+        ck_freePool( pool );
+    }
+}
+
+void checkTTL( void )
+{
+    // TTL blocks expire within a few ticks after their time's
+    // up, and never before; ck_refTTL() can push it back but
+    // never brings it closer
+    enum { TICK = 10, STEP = 5, BLOCKS = 4 };
+    uint64_t ttls[BLOCKS] = { 50, 100, 700, 2000 };
+    uint64_t died[BLOCKS] = { 0 };
+    unsigned ids[BLOCKS];
+    ck_Pool* pool = cPool( 0 );
+    fakeNow = 1000;
+    ck_useTime( pool, &cNow, TICK );
+    
+    Obj* blocks[BLOCKS];
+    for( unsigned i = 0 ; i < BLOCKS ; i++ )
+    {
+        blocks[i] = ck_allocSlimTTL( pool, sizeof(Obj), ttls[i] );
+        memset( blocks[i], 0, sizeof(Obj) );
+        blocks[i]->id = ids[i] = nextId++;
+    }
+    ck_refTTL( pool, blocks[1], 500 );
+    ck_refTTL( pool, blocks[3], 10 );
+    ttls[1] = 500;
+    
+    for( uint64_t t = 0 ; t < 3000 ; t += STEP )
+    {
+        fakeNow = 1000 + t;
+        ck_catchUp( pool );
+        if( checkFlags & CK_DEFER_FINALIZE )
+            ck_runFinalizers( pool, SIZE_MAX );
+        for( unsigned i = 0 ; i < BLOCKS ; i++ )
+        {
+            if( gone[ids[i]] && died[i] == 0 )
+                died[i] = t;
+        }
+    }
+    for( unsigned i = 0 ; i < BLOCKS ; i++ )
+        CHECK( died[i] >= ttls[i] && died[i] <= ttls[i] + 3 * TICK );
+    ck_freePool( pool );
+}
+
+void checkIdle( void )
+{
+    // on the monotonic clock the timer fd wakes a loop that
+    // does the work in ck_onIdle(), and that alone is enough
+    // for a dropped kid to go
+    ck_Pool* pool   = cPool( 0 );
+    Obj*     root   = cObj( pool, NULL, true );
+    void*    keep   = cObj( pool, root, false );
+    void*    drop   = cObj( pool, root, false );
+    unsigned dropId = cId( drop );
+    root->kids[0] = keep;
+    root->kids[1] = drop;
+    root->nKids   = 2;
+    ck_useTime( pool, NULL, 100000 );
+    
+    struct pollfd wait = { .fd = ck_getTimerFd( pool ), .events = POLLIN };
+    CHECK( wait.fd >= 0 );
+    if( wait.fd < 0 )
+    {
+        ck_freePool( pool );
+        return;
+    }
+    
+    // a cycle's about 25ms, so a second's plenty
+    size_t   steps = 0;
+    unsigned wakes = 0;
+    for( unsigned i = 0 ; i < 1000 && !gone[dropId] ; i++ )
+    {
+        if( poll( &wait, 1, 10 ) > 0 )
+        {
+            wakes++;
+            steps += ck_onIdle( pool, UINT64_MAX );
+            if( checkFlags & CK_DEFER_FINALIZE )
+                ck_runFinalizers( pool, SIZE_MAX );
+        }
+        if( i == 10 )
+            root->kids[1] = NULL;
+    }
+    CHECK( wakes > 0 && steps > 0 );
+    CHECK( root->kids[1] == NULL && gone[dropId] && !gone[cId( keep )] );
+    ck_freePool( pool );
+}
+
+void checkFreeze( void )
+{
+    // frozen sets are neither preserved nor expired, whatever
+    // they hold; once thawed they're back on a schedule, the
+    // kept set stays and the unrooted one goes
+    ck_Pool* pool = cPool( 0 );
+    Obj*     roots[2];
+    unsigned ids[2][3];
+    for( unsigned i = 0 ; i < 2 ; i++ )
+    {
+        Obj* root = roots[i] = cObj( pool, NULL, true );
+        Obj* kid  = cObj( pool, root, true );
+        Obj* leaf = cObj( pool, kid, false );
+        root->kids[root->nKids++] = kid;
+        kid->kids[kid->nKids++]   = leaf;
+        ids[i][0] = cId( root );
+        ids[i][1] = cId( kid );
+        ids[i][2] = cId( leaf );
+        CHECK( ck_freeze( pool, root ) == 0 );
+        CHECK( ck_freeze( pool, kid ) == -1 );
+    }
+    ck_unroot( pool, roots[1], NULL );
+    
+    preserves = 0;
+    cSettle( pool, 4 );
+    CHECK( preserves == 0 );
+    for( unsigned i = 0 ; i < 2 ; i++ )
+        CHECK( !gone[ids[i][0]] && !gone[ids[i][1]] && !gone[ids[i][2]] );
+    
+    CHECK( ck_thaw( pool, roots[0] ) == 0 && ck_thaw( pool, roots[1] ) == 0 );
+    CHECK( ck_thaw( pool, roots[0] ) == -1 );
+    
+    // with CK_ADAPTIVE a thawed block waits out the longest
+    // period, 32 cycles, in case something's still holding it
+    cSettle( pool, checkFlags & CK_ADAPTIVE ? 36 : 4 );
+    CHECK( preserves > 0 );
+    CHECK( !gone[ids[0][0]] && !gone[ids[0][1]] && !gone[ids[0][2]] );
+    CHECK( gone[ids[1][0]] && gone[ids[1][1]] && gone[ids[1][2]] );
+    ck_freePool( pool );
+}
+
+void checkCollectAll( void )
+{
+    // a cycle nothing reaches goes in one full collection,
+    // without waiting out its preservations, and what the
+    // root holds stays
+    ck_Pool* pool = cPool( 0 );
+    Obj*     root = cObj( pool, NULL, true );
+    Obj*     kid  = cObj( pool, root, true );
+    Obj*     a    = cObj( pool, root, true );
+    Obj*     b    = cObj( pool, a, true );
+    unsigned aId  = cId( a );
+    unsigned bId  = cId( b );
+    root->kids[0] = kid;
+    root->kids[1] = a;
+    root->nKids   = 2;
+    a->kids[0]    = b;
+    a->nKids      = 1;
+    b->kids[0]    = a;
+    b->nKids      = 1;
+    cSettle( pool, 2 );
+    
+    root->kids[1] = NULL;
+    CHECK( ck_collectAll( pool ) >= 2 * sizeof(Obj) );
+    if( checkFlags & CK_DEFER_FINALIZE )
+        ck_runFinalizers( pool, SIZE_MAX );
+    CHECK( gone[aId] && gone[bId] );
+    CHECK( !gone[cId( root )] && !gone[cId( kid )] );
+    
+    cSettle( pool, 2 );
+    CHECK( !gone[cId( root )] && !gone[cId( kid )] );
+    ck_freePool( pool );
+}
+
+void checkFallback( void )
+{
+    // a dropped cycle takes a few cycles to find, more than an
+    // allocation collects, so with the quota full the next one
+    // only fits if CK_COLLECT_ALL traces the pool for it
+    size_t fat = ck_blockSize( sizeof(Obj), 1 );
+    for( unsigned i = 0 ; i < 2 ; i++ )
+    {
+        ck_Config config = cConfig( i ? CK_COLLECT_ALL : 0 );
+        config.quota     = 4 * fat - 1;
+        memset( gone, 0, sizeof(gone) );
+        nextId = 1;
+        
+        ck_Pool* pool = ck_makePool( &config );
+        Obj*     root = cObj( pool, NULL, true );
+        Obj*     a    = cObj( pool, root, true );
+        Obj*     b    = cObj( pool, a, true );
+        unsigned aId  = cId( a );
+        unsigned bId  = cId( b );
+        a->kids[a->nKids++] = b;
+        b->kids[b->nKids++] = a;
+        ck_ref( pool, a, b );
+        root->kids[root->nKids++] = a;
+        cSettle( pool, 2 );
+        
+        root->kids[0] = NULL;
+        Obj* obj = cObj( pool, root, true );
+        if( checkFlags & CK_DEFER_FINALIZE )
+            ck_runFinalizers( pool, SIZE_MAX );
+        CHECK( (obj != NULL) == (i == 1) );
+        CHECK( gone[aId] == (i == 1) && gone[bId] == (i == 1) );
+        CHECK( !gone[cId( root )] );
+        ck_freePool( pool );
+    }
+}